@@ -0,0 +1,29 @@
+#version 330 core
+
+// Must match MAX_OBJECTS in the program
+#define MAX_OBJECTS 16
+
+// input data : shared tile mesh
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexColor;
+
+// input data : one entry per tile, advanced once per instance
+layout (location = 2) in vec3 tileOffset;
+layout (location = 3) in vec3 tileColor;
+
+// Per frame transforms, shared by every program (uploaded once per frame)
+// The floor lives in world space, so only VP is used
+layout (std140) uniform Transforms {
+    mat4 VP;
+    mat4 model[MAX_OBJECTS];
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    fragColor = vertexColor * tileColor;
+
+    gl_Position = VP * vec4(vertexPosition + tileOffset, 1);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+// Must match MAX_OBJECTS in the program
+#define MAX_OBJECTS 16
+
+// input data : sent from main program
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexColor;
+layout (location = 4) in int objectIndex;
+
+// Per frame transforms, shared by every program (uploaded once per frame)
+layout (std140) uniform Transforms {
+    mat4 VP;
+    mat4 model[MAX_OBJECTS];
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+
+    // The color of each vertex will be interpolated
+    // to produce the color of each fragment
+    fragColor = vertexColor;
+
+    // Output position of the vertex, in clip space : VP * model * position
+    gl_Position = VP * model[objectIndex] * v;
+}
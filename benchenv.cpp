@@ -0,0 +1,139 @@
+/* Batch environment benchmark - checks batch_env_step against sim_move, then measures its throughput */
+/* usage: benchenv [-n games] [-s steps] <level file[:index]> */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdint.h>
+
+#include "simulation.h"
+#include "bitboard.h"
+#include "level.h"
+#include "levelpack.h"
+#include "batch_env.h"
+
+using namespace std;
+
+#define INPUT_ROUNDS 64 // distinct input arrays cycled through, so generating them stays out of the timing
+
+uint32_t rng_state = 2463534242u;
+
+/* xorshift32 - fast and reproducible, quality doesn't matter here */
+uint32_t next_random ()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* Random moves for every game, with some MOVE_NONE mixed in */
+void random_inputs (vector<int8_t>& input)
+{
+	for(size_t i=0;i<input.size();i++)
+		input[i] = (int)(next_random() % (NUM_MOVES+1)) - 1;
+}
+
+/* Step a batch and, game by game, the same moves through sim_move - returns the mismatches */
+int check (const struct level& l, const struct bitboard& board, int games, int steps)
+{
+	struct batch_env env;
+	batch_env_init(env, board, l.start, l.goal_x, l.goal_y, games);
+	vector<struct sim_pose> poses(games, l.start);
+	vector<int8_t> input(games), status(games);
+	int mismatches = 0;
+
+	for(int step=0;step<steps;step++)
+	{
+		random_inputs(input);
+		batch_env_step(env, &input[0], &status[0]);
+		for(int i=0;i<games;i++)
+		{
+			struct sim_pose pose = poses[i];
+			int expected = ENV_PLAYING;
+			if(input[i] != MOVE_NONE)
+			{
+				pose = sim_move(pose, input[i]);
+				if(!bitboard_supported(board, pose))
+					expected = ENV_FELL;
+				else if(pose.x == l.goal_x && pose.y == l.goal_y && pose.orientation == ORIENT_UP)
+					expected = ENV_GOAL;
+			}
+			if(expected != ENV_PLAYING)
+				pose = l.start;
+			poses[i] = pose;
+
+			if(status[i] != expected || env.x[i] != pose.x || env.y[i] != pose.y || env.orientation[i] != pose.orientation)
+			{
+				if(mismatches++ < 10)
+					fprintf(stderr, "step %d game %d: batch_env gives status %d at %d,%d/%d, sim_move %d at %d,%d/%d\n",
+					        step, i, status[i], env.x[i], env.y[i], env.orientation[i], expected, pose.x, pose.y, pose.orientation);
+				env.x[i] = pose.x; // carry on from the reference
+				env.y[i] = pose.y;
+				env.orientation[i] = pose.orientation;
+			}
+		}
+	}
+	return mismatches;
+}
+
+int main (int argc, char** argv)
+{
+	int games = 4096, steps = 20000;
+	const char *level_name = NULL;
+	int i;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i], "-n")==0 && i+1<argc)
+			games = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-s")==0 && i+1<argc)
+			steps = atoi(argv[++i]);
+		else
+			level_name = argv[i];
+	}
+	if(level_name == NULL || games < 1 || steps < 1) {
+		fprintf(stderr, "usage: %s [-n games] [-s steps] <level file[:index]>\n", argv[0]);
+		return 2;
+	}
+
+	struct level l;
+	string error;
+	if(!load_level(level_name, l, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	struct bitboard board;
+	bitboard_build(board, level_board(l));
+
+	int mismatches = check(l, board, 256, 2000);
+	if(mismatches > 0) {
+		fprintf(stderr, "%s: %d mismatches against sim_move\n", l.name.c_str(), mismatches);
+		return 1;
+	}
+
+	vector< vector<int8_t> > inputs(INPUT_ROUNDS, vector<int8_t>(games));
+	for(i=0;i<INPUT_ROUNDS;i++)
+		random_inputs(inputs[i]);
+	vector<int8_t> status(games);
+	struct batch_env env;
+	batch_env_init(env, board, l.start, l.goal_x, l.goal_y, games);
+
+	long long goals = 0, falls = 0;
+	chrono::steady_clock::time_point started = chrono::steady_clock::now();
+	for(int step=0;step<steps;step++)
+	{
+		batch_env_step(env, &inputs[step % INPUT_ROUNDS][0], &status[0]);
+		goals += status[0] == ENV_GOAL; // keeps the results live
+		falls += status[games-1] == ENV_FELL;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+	double total = (double)games*steps;
+	printf("%s: %d games x %d steps in %.3f s, %.1fM game steps/s (%lld goals, %lld falls sampled)\n",
+	       l.name.c_str(), games, steps, seconds, total/seconds/1e6, goals, falls);
+	return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+/* Bit packed board - one bit per cell, rows of 64-bit words */
+/* Besides the floor itself, a plane is kept for each lying orientation with the bit set where */
+/* both cells under the block are floor, so "is this pose supported" is a single bit test. */
+/* Rows are padded to a multiple of 4 words (256 bits) so the plane updates run as straight */
+/* vectorizable loops, and a border of empty cells around the board lets a move from any pose */
+/* on the board be tested without bounds checks. */
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "simulation.h"
+
+#define BITBOARD_BORDER 2 // no move goes further than 2 cells
+
+struct bitboard {
+	int width;
+	int height;
+	int stride;                      // words per row, a multiple of 4
+	std::vector<uint64_t> planes[3]; // [orientation] - ORIENT_UP is the floor itself
+};
+
+inline size_t bitboard_bit (const struct bitboard& b, int x, int y)
+{
+	return (size_t)(y+BITBOARD_BORDER)*b.stride*64 + (x+BITBOARD_BORDER);
+}
+
+inline bool bitboard_test (const std::vector<uint64_t>& plane, size_t bit)
+{
+	return (plane[bit>>6] >> (bit&63)) & 1;
+}
+
+/* Recompute the lying planes from the floor plane - call after changing floor cells */
+inline void bitboard_update (struct bitboard& b)
+{
+	const uint64_t *floor = &b.planes[ORIENT_UP][0];
+	uint64_t *along_x = &b.planes[ORIENT_X][0];
+	uint64_t *along_y = &b.planes[ORIENT_Y][0];
+	size_t words = b.planes[ORIENT_UP].size();
+	size_t row = b.stride;
+	size_t i;
+
+	// Along x: cells x and x+1, so the floor shifted down by one bit, carrying in from the next word
+	for(i=0;i+1<words;i++)
+		along_x[i] = floor[i] & ((floor[i] >> 1) | (floor[i+1] << 63));
+	along_x[words-1] = floor[words-1] & (floor[words-1] >> 1);
+
+	// Along y: cells y and y-1, so the floor ANDed with the row below
+	for(i=0;i<row;i++)
+		along_y[i] = 0;
+	for(i=row;i<words;i++)
+		along_y[i] = floor[i] & floor[i-row];
+}
+
+/* Build from a board of cells - any non zero cell is floor */
+inline void bitboard_build (struct bitboard& b, const struct sim_board& board)
+{
+	int x, y, o;
+	b.width = board.width;
+	b.height = board.height;
+	b.stride = ((board.width + 2*BITBOARD_BORDER + 255) / 256) * 4;
+	size_t words = (size_t)(board.height + 2*BITBOARD_BORDER) * b.stride;
+	for(o=0;o<3;o++)
+		b.planes[o].assign(words, 0);
+
+	for(x=0;x<board.width;x++)
+	{
+		for(y=0;y<board.height;y++)
+		{
+			if(board.cells[x*board.height + y] != 0)
+			{
+				size_t bit = bitboard_bit(b, x, y);
+				b.planes[ORIENT_UP][bit>>6] |= (uint64_t)1 << (bit&63);
+			}
+		}
+	}
+	bitboard_update(b);
+}
+
+inline bool bitboard_floor (const struct bitboard& b, int x, int y)
+{
+	if(x<0 || x>=b.width || y<0 || y>=b.height)
+		return false;
+	return bitboard_test(b.planes[ORIENT_UP], bitboard_bit(b, x, y));
+}
+
+/* Supported test for a pose known to be within BITBOARD_BORDER of the board, */
+/* e.g. any move away from a supported pose */
+inline bool bitboard_supported_near (const struct bitboard& b, struct sim_pose pose)
+{
+	return bitboard_test(b.planes[pose.orientation], bitboard_bit(b, pose.x, pose.y));
+}
+
+/* True if every cell under the block is floor, for any pose */
+inline bool bitboard_supported (const struct bitboard& b, struct sim_pose pose)
+{
+	if(pose.x<0 || pose.x>=b.width || pose.y<0 || pose.y>=b.height)
+		return false;
+	return bitboard_supported_near(b, pose);
+}
+
+/* Bit m set for every move m that leaves the block supported - pose must be supported */
+inline int bitboard_successors (const struct bitboard& b, struct sim_pose pose)
+{
+	int move, legal = 0;
+	for(move=0;move<NUM_MOVES;move++)
+		legal |= bitboard_supported_near(b, sim_move(pose, move)) << move;
+	return legal;
+}
+
+#endif
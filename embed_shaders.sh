@@ -0,0 +1,28 @@
+#!/bin/sh
+# Write the shader files given as a C++ header of constexpr strings, looked up by file name
+# usage: embed_shaders.sh <shader>... > shaders.h   (run by make)
+
+echo "/* Generated by embed_shaders.sh from the shader files - edit those instead */"
+echo "#ifndef SHADERS_H"
+echo "#define SHADERS_H"
+echo
+for file in "$@"; do
+	name=$(basename "$file" | tr -c 'A-Za-z0-9\n' '_' | tr 'A-Z' 'a-z')
+	printf 'static constexpr const char shader_%s[] = R"glsl(' "$name"
+	cat "$file"
+	printf ')glsl";\n\n'
+done
+echo "struct embedded_shader {"
+echo "	const char *name;"
+echo "	const char *source;"
+echo "};"
+echo
+echo "static constexpr struct embedded_shader embedded_shaders[] = {"
+for file in "$@"; do
+	name=$(basename "$file" | tr -c 'A-Za-z0-9\n' '_' | tr 'A-Z' 'a-z')
+	printf '\t{ "%s", shader_%s },\n' "$(basename "$file")" "$name"
+done
+echo "	{ 0, 0 }"
+echo "};"
+echo
+echo "#endif"
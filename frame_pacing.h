@@ -0,0 +1,124 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+/* How the main loop paces its frames (--pacing) */
+/*   vsync     - swap interval 1, the display sets the rate                                   */
+/*   uncapped  - swap interval 0 and no limiter, as many frames as the render path can make   */
+/*   <n>       - swap interval 0 and a limiter holding n frames a second: it sleeps until just */
+/*               before the frame is due and spins the rest, since sleeps overshoot by up to  */
+/*               a scheduler tick; the frame then starts with fresh input instead of waiting  */
+/*               in the swap queue                                                           */
+/*   adaptive  - swap interval -1 (late frames tear instead of waiting a whole refresh) where */
+/*               the driver has swap_control_tear, plain vsync otherwise                     */
+
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#include "frame_stats.h"
+
+enum {
+	PACING_VSYNC,
+	PACING_UNCAPPED,
+	PACING_FIXED,
+	PACING_ADAPTIVE
+};
+
+#define PACING_SPIN_MARGIN 0.002 // seconds of a fixed rate frame spent spinning rather than asleep
+
+struct frame_pacer {
+	int mode;
+	double fps;          // PACING_FIXED target
+	double deadline;     // when the next fixed rate frame is due, 0 before the first
+	double last_present; // when the last frame was presented, 0 before the first
+};
+
+inline void frame_pacer_init (struct frame_pacer& pacer, int mode, double fps)
+{
+	pacer.mode = mode;
+	pacer.fps = fps;
+	pacer.deadline = 0;
+	pacer.last_present = 0;
+}
+
+/* Parse a --pacing argument - false if it isn't one */
+inline bool frame_pacer_parse (struct frame_pacer& pacer, const std::string& text)
+{
+	if(text == "vsync")
+		frame_pacer_init(pacer, PACING_VSYNC, 0);
+	else if(text == "uncapped")
+		frame_pacer_init(pacer, PACING_UNCAPPED, 0);
+	else if(text == "adaptive")
+		frame_pacer_init(pacer, PACING_ADAPTIVE, 0);
+	else if(!text.empty() && text.find_first_not_of("0123456789.") == std::string::npos && atof(text.c_str()) > 0)
+		frame_pacer_init(pacer, PACING_FIXED, atof(text.c_str()));
+	else
+		return false;
+	return true;
+}
+
+inline const char* frame_pacer_name (const struct frame_pacer& pacer)
+{
+	static const char *names[] = { "vsync", "uncapped", "fixed", "adaptive" };
+	return names[pacer.mode];
+}
+
+/* Swap interval for the mode - tear_control tells if the driver takes negative intervals */
+inline int frame_pacer_swap_interval (const struct frame_pacer& pacer, bool tear_control)
+{
+	switch(pacer.mode)
+	{
+		case PACING_UNCAPPED:
+		case PACING_FIXED:
+			return 0;
+		case PACING_ADAPTIVE:
+			return tear_control ? -1 : 1;
+		default:
+			return 1;
+	}
+}
+
+/* Hold the loop until the next fixed rate frame is due; returns at once in the other modes */
+inline void frame_pacer_wait (struct frame_pacer& pacer)
+{
+	if(pacer.mode != PACING_FIXED)
+		return;
+	double period = 1/pacer.fps;
+	double now = frame_stats_now();
+	if(pacer.deadline == 0 || now - pacer.deadline > period)
+		pacer.deadline = now; // first frame, or too far behind to catch up - start over from here
+	else
+	{
+		if(pacer.deadline - now > PACING_SPIN_MARGIN)
+			std::this_thread::sleep_for(std::chrono::duration<double>(pacer.deadline - now - PACING_SPIN_MARGIN));
+		while(frame_stats_now() < pacer.deadline)
+			;
+	}
+	pacer.deadline += period;
+}
+
+/* Note that a frame was presented, recording the interval since the last one in stats */
+inline void frame_pacer_presented (struct frame_pacer& pacer, struct frame_stats& stats)
+{
+	double now = frame_stats_now();
+	if(pacer.last_present != 0)
+		phase_add(stats, PHASE_INTERVAL, (now - pacer.last_present) * 1000);
+	pacer.last_present = now;
+}
+
+/* Forget the last frame, so that a pause (idle, a stall) isn't counted as an interval */
+inline void frame_pacer_reset (struct frame_pacer& pacer)
+{
+	pacer.deadline = 0;
+	pacer.last_present = 0;
+}
+
+/* Pacing jitter - how much longer than the median the slowest 1% of frame intervals are */
+inline float frame_pacer_jitter (const struct frame_stats& stats)
+{
+	struct phase_summary interval = phase_summarize(stats.phases[PHASE_INTERVAL]);
+	return interval.p99 - interval.p50;
+}
+
+#endif
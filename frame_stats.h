@@ -0,0 +1,105 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+/* Rolling frame time statistics for each phase of the main loop */
+/* A phase keeps its last FRAME_STATS_WINDOW samples in a ring, so recording one is a single */
+/* store; the percentiles are worked out from a copy only when a report is asked for. */
+
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+
+enum {
+	PHASE_TICKS,      // check_key_functions, every tick run in the frame
+	PHASE_DRAW_TILES,
+	PHASE_DRAW_BLOCK,
+	PHASE_SWAP,       // glfwSwapBuffers
+	PHASE_POLL,       // glfwPollEvents
+	PHASE_GPU_TILES,  // GPU time of the floor pass, from timer queries
+	PHASE_GPU_BLOCK,  // GPU time of the block pass
+	PHASE_INTERVAL,   // time between one frame being presented and the next
+	PHASE_FRAME,      // the whole loop iteration
+	NUM_PHASES
+};
+
+#define FRAME_STATS_WINDOW 1024 // samples per phase the percentiles are taken over
+
+inline const char* phase_name (int phase)
+{
+	static const char *names[NUM_PHASES] = { "ticks", "draw_tiles", "draw_block", "swap", "poll", "gpu_tiles", "gpu_block", "interval", "frame" };
+	return names[phase];
+}
+
+struct phase_stats {
+	float ms[FRAME_STATS_WINDOW];
+	int count; // samples held, up to FRAME_STATS_WINDOW
+	int next;  // ring position of the next sample
+	double started;
+};
+
+struct frame_stats {
+	struct phase_stats phases[NUM_PHASES];
+};
+
+struct phase_summary {
+	int count;
+	float p50, p99, max;
+};
+
+/* Seconds on a monotonic clock */
+inline double frame_stats_now ()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void phase_add (struct frame_stats& s, int phase, double ms)
+{
+	struct phase_stats& p = s.phases[phase];
+	p.ms[p.next] = ms;
+	p.next = (p.next + 1) % FRAME_STATS_WINDOW;
+	if(p.count < FRAME_STATS_WINDOW)
+		p.count++;
+}
+
+inline void phase_begin (struct frame_stats& s, int phase)
+{
+	s.phases[phase].started = frame_stats_now();
+}
+
+inline void phase_end (struct frame_stats& s, int phase)
+{
+	phase_add(s, phase, (frame_stats_now() - s.phases[phase].started) * 1000);
+}
+
+inline struct phase_summary phase_summarize (const struct phase_stats& p)
+{
+	struct phase_summary summary = { p.count, 0, 0, 0 };
+	if(p.count == 0)
+		return summary;
+	float sorted[FRAME_STATS_WINDOW];
+	std::copy(p.ms, p.ms + p.count, sorted);
+	int i50 = p.count/2, i99 = (p.count*99)/100;
+	std::nth_element(sorted, sorted + i50, sorted + p.count);
+	summary.p50 = sorted[i50];
+	std::nth_element(sorted + i50, sorted + i99, sorted + p.count);
+	summary.p99 = sorted[i99];
+	summary.max = *std::max_element(sorted + i99, sorted + p.count);
+	return summary;
+}
+
+/* One table of p50/p99/max per phase, headed by the time it was taken at */
+inline void frame_stats_report (const struct frame_stats& s, FILE *out, double time)
+{
+	fprintf(out, "frame times at %.1f s, last %d frames\n", time, s.phases[PHASE_FRAME].count);
+	fprintf(out, "%-12s %9s %9s %9s\n", "phase", "p50 ms", "p99 ms", "max ms");
+	for(int phase=0;phase<NUM_PHASES;phase++)
+	{
+		struct phase_summary summary = phase_summarize(s.phases[phase]);
+		if(summary.count == 0)
+			continue;
+		fprintf(out, "%-12s %9.3f %9.3f %9.3f\n", phase_name(phase), summary.p50, summary.p99, summary.max);
+	}
+	fflush(out);
+}
+
+#endif
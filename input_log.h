@@ -0,0 +1,93 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+/* Binary log of the moves handed to the simulation, for replaying a session exactly */
+/* The simulation only sees input through sim_step, once per tick, so a move stamped with */
+/* the tick it was applied on replays to the same states at any speed, drawn or not. The */
+/* wall clock time is kept alongside for reference. Layout (little endian): */
+/*   header - magic "BLXI", version, tick rate the session ran at */
+/*   events - tick, time in ms since recording started, move (MOVE_LEFT..MOVE_UP) */
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#include "simulation.h"
+
+#define INPUT_LOG_MAGIC "BLXI"
+#define INPUT_LOG_VERSION 1
+
+struct input_log_header {
+	char magic[4];
+	uint32_t version;
+	double tick_rate;
+};
+
+struct input_event {
+	uint32_t tick;
+	uint32_t time_ms;
+	uint8_t move;
+	uint8_t reserved[3];
+};
+
+/* Start a log - returns NULL if the file can't be written */
+inline FILE* input_log_create (const char *path, double tick_rate)
+{
+	FILE *out = fopen(path, "wb");
+	if(out == NULL)
+		return NULL;
+	struct input_log_header header;
+	memcpy(header.magic, INPUT_LOG_MAGIC, 4);
+	header.version = INPUT_LOG_VERSION;
+	header.tick_rate = tick_rate;
+	fwrite(&header, sizeof(header), 1, out);
+	fflush(out);
+	return out;
+}
+
+/* Flushed straight away - a move is a key press, so this is cheap, and a session that ends */
+/* abruptly still leaves a log that replays up to its last move */
+inline void input_log_write (FILE *out, uint32_t tick, double time, int move)
+{
+	struct input_event e;
+	memset(&e, 0, sizeof(e));
+	e.tick = tick;
+	e.time_ms = (uint32_t)(time*1000);
+	e.move = move;
+	fwrite(&e, sizeof(e), 1, out);
+	fflush(out);
+}
+
+/* Read a whole log - returns false and sets error if it can't be used */
+inline bool input_log_read (const char *path, struct input_log_header& header, std::vector<struct input_event>& events, std::string& error)
+{
+	FILE *in = fopen(path, "rb");
+	if(in == NULL) {
+		error = std::string(path) + ": can't open";
+		return false;
+	}
+	if(fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, INPUT_LOG_MAGIC, 4) != 0
+	   || header.version != INPUT_LOG_VERSION || !(header.tick_rate > 0))
+	{
+		fclose(in);
+		error = std::string(path) + ": not an input log";
+		return false;
+	}
+	events.clear();
+	struct input_event e;
+	while(fread(&e, sizeof(e), 1, in) == 1)
+	{
+		if(e.move >= NUM_MOVES || (!events.empty() && e.tick < events.back().tick)) {
+			fclose(in);
+			error = std::string(path) + ": corrupt event";
+			return false;
+		}
+		events.push_back(e);
+	}
+	fclose(in);
+	return true;
+}
+
+#endif
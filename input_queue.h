@@ -0,0 +1,73 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+/* Moves from the key callbacks to the simulation tick, in the order they were pressed */
+/* Single producer (the thread running the GLFW callbacks), single consumer (the thread */
+/* running the ticks): each side only stores to its own index, so neither ever blocks. */
+/* At most lookahead moves are buffered ahead of the block - presses beyond that are */
+/* dropped, and counted, rather than played long after the player has moved on. */
+
+#include <atomic>
+#include <stdint.h>
+
+#define INPUT_QUEUE_SIZE 16 // a power of two, the largest look-ahead that can be asked for
+
+struct input_queue {
+	std::atomic<uint32_t> head; // moves ever pushed - written by the producer
+	std::atomic<uint32_t> tail; // moves ever popped - written by the consumer
+	int8_t moves[INPUT_QUEUE_SIZE];
+	int lookahead;
+	uint32_t dropped; // presses refused for being beyond the look-ahead - read it on the producer thread
+};
+
+inline void input_queue_init (struct input_queue& q, int lookahead)
+{
+	q.head.store(0, std::memory_order_relaxed);
+	q.tail.store(0, std::memory_order_relaxed);
+	if(lookahead < 1)
+		lookahead = 1;
+	if(lookahead > INPUT_QUEUE_SIZE)
+		lookahead = INPUT_QUEUE_SIZE;
+	q.lookahead = lookahead;
+	q.dropped = 0;
+}
+
+/* Producer - false if lookahead moves are already waiting */
+inline bool input_queue_push (struct input_queue& q, int move)
+{
+	uint32_t head = q.head.load(std::memory_order_relaxed);
+	uint32_t tail = q.tail.load(std::memory_order_acquire);
+	if(head - tail >= (uint32_t)q.lookahead) {
+		q.dropped++;
+		return false;
+	}
+	q.moves[head & (INPUT_QUEUE_SIZE-1)] = move;
+	q.head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/* Consumer - false if no move is waiting */
+inline bool input_queue_pop (struct input_queue& q, int& move)
+{
+	uint32_t tail = q.tail.load(std::memory_order_relaxed);
+	uint32_t head = q.head.load(std::memory_order_acquire);
+	if(tail == head)
+		return false;
+	move = q.moves[tail & (INPUT_QUEUE_SIZE-1)];
+	q.tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+/* Consumer - true if no move is waiting */
+inline bool input_queue_empty (const struct input_queue& q)
+{
+	return q.tail.load(std::memory_order_relaxed) == q.head.load(std::memory_order_acquire);
+}
+
+/* Consumer - drop every waiting move */
+inline void input_queue_clear (struct input_queue& q)
+{
+	q.tail.store(q.head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+/* Hand authored text levels */
+/* One character per cell, one line per row, the first line being the row furthest up (largest y): */
+/*   '.' or ' ' - no floor    'o' - floor    'S' - start, block standing    'G' - goal */
+/* A file can hold several levels separated by blank lines; lines starting with '#' are comments. */
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <sstream>
+
+#include "simulation.h"
+
+struct level {
+	std::string name;
+	int width;
+	int height;
+	std::vector<int> cells; // x*height + y, as sim_board
+	struct sim_pose start;
+	int goal_x;
+	int goal_y;
+};
+
+inline struct sim_board level_board (const struct level& l)
+{
+	struct sim_board board = { l.width, l.height, l.cells.empty() ? NULL : &l.cells[0] };
+	return board;
+}
+
+/* Build a level from its rows - returns false and sets error if it is malformed */
+inline bool level_from_rows (const std::vector<std::string>& rows, struct level& l, std::string& error)
+{
+	size_t i, j;
+	int starts = 0, goals = 0;
+	l.height = rows.size();
+	l.width = 0;
+	for(i=0;i<rows.size();i++)
+		if((int)rows[i].size() > l.width)
+			l.width = rows[i].size();
+	l.cells.assign(l.width*l.height, 0);
+
+	for(i=0;i<rows.size();i++)
+	{
+		int y = l.height-1-i;
+		for(j=0;j<rows[i].size();j++)
+		{
+			int x = j;
+			switch(rows[i][j])
+			{
+				case '.':
+				case ' ':
+					break;
+				case 'S':
+					l.start.x = x;
+					l.start.y = y;
+					l.start.orientation = ORIENT_UP;
+					starts++;
+					l.cells[x*l.height + y] = 1;
+					break;
+				case 'G':
+					l.goal_x = x;
+					l.goal_y = y;
+					goals++;
+					l.cells[x*l.height + y] = 2;
+					break;
+				case 'o':
+					l.cells[x*l.height + y] = 1;
+					break;
+				default:
+					error = l.name + ": unknown cell '" + rows[i][j] + "'";
+					return false;
+			}
+		}
+	}
+	if(starts != 1 || goals != 1)
+	{
+		error = l.name + ": needs exactly one S and one G";
+		return false;
+	}
+	return true;
+}
+
+/* Append every level in the stream to levels, named <name>:<index> */
+inline bool parse_levels (std::istream& in, const std::string& name, std::vector<struct level>& levels, std::string& error)
+{
+	std::vector<std::string> rows;
+	std::string line;
+	int index = 0;
+	bool more = true;
+	while(more)
+	{
+		more = (bool)getline(in, line);
+		if(more && !line.empty() && line[line.size()-1] == '\r')
+			line.erase(line.size()-1);
+		if(more && !line.empty() && line[0] == '#')
+			continue;
+		if(more && !line.empty())
+		{
+			rows.push_back(line);
+			continue;
+		}
+		// blank line or end of file closes the level being read
+		if(rows.empty())
+			continue;
+		struct level l;
+		std::ostringstream level_name;
+		level_name << name << ":" << index++;
+		l.name = level_name.str();
+		if(!level_from_rows(rows, l, error))
+			return false;
+		levels.push_back(l);
+		rows.clear();
+	}
+	return true;
+}
+
+#endif
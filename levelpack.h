@@ -0,0 +1,333 @@
+#ifndef LEVELPACK_H
+#define LEVELPACK_H
+
+/* Binary level packs - many levels in one file, opened with mmap */
+/* Layout (little endian):                                                                   */
+/*   header     - magic "BLXP", version, level count, reserved                                */
+/*   offsets    - one uint64 per level, the byte offset of its record from the start of file */
+/*   records    - a record header (size, start pose, goal) followed by the cells, one bit each */
+/*                in x*height + y order like sim_board, padded to the next 8 byte boundary   */
+/* Opening a pack only maps it; a level is read (and its pages touched) when it is fetched,   */
+/* so packs of any size open instantly. Packs are written from text levels by packlevels.     */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "simulation.h"
+#include "level.h"
+
+#define LEVELPACK_MAGIC "BLXP"
+#define LEVELPACK_VERSION 1
+
+struct levelpack_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct levelpack_record {
+	uint16_t width;
+	uint16_t height;
+	int16_t start_x;
+	int16_t start_y;
+	uint8_t start_orientation;
+	uint8_t reserved[3];
+	int16_t goal_x;
+	int16_t goal_y;
+};
+
+struct level_pack {
+	std::string path;
+	const unsigned char *data; // the mapped file
+	size_t size;
+	uint32_t count;
+};
+
+inline size_t levelpack_cell_bytes (int width, int height)
+{
+	return ((size_t)width*height + 7) / 8;
+}
+
+inline size_t levelpack_record_size (int width, int height)
+{
+	return (sizeof(struct levelpack_record) + levelpack_cell_bytes(width, height) + 7) & ~(size_t)7;
+}
+
+/* Map a pack and check its header - returns false and sets error if it can't be used */
+inline bool level_pack_open (struct level_pack& pack, const std::string& path, std::string& error)
+{
+	pack.path = path;
+	pack.data = NULL;
+	pack.size = 0;
+	pack.count = 0;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		error = path + ": can't open";
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct levelpack_header)) {
+		close(fd);
+		error = path + ": not a level pack";
+		return false;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file
+	if(data == MAP_FAILED) {
+		error = path + ": can't map";
+		return false;
+	}
+	pack.data = (const unsigned char*)data;
+	pack.size = st.st_size;
+
+	struct levelpack_header header;
+	memcpy(&header, pack.data, sizeof(header));
+	if(memcmp(header.magic, LEVELPACK_MAGIC, 4) != 0 || header.version != LEVELPACK_VERSION
+	   || (pack.size - sizeof(header)) / sizeof(uint64_t) < header.count)
+	{
+		error = path + ": not a level pack";
+		munmap(data, pack.size);
+		pack.data = NULL;
+		return false;
+	}
+	pack.count = header.count;
+	return true;
+}
+
+inline void level_pack_close (struct level_pack& pack)
+{
+	if(pack.data != NULL)
+		munmap((void*)pack.data, pack.size);
+	pack.data = NULL;
+	pack.size = 0;
+	pack.count = 0;
+}
+
+inline std::string level_pack_name (const struct level_pack& pack, int index)
+{
+	char name[32];
+	snprintf(name, sizeof(name), ":%d", index);
+	return pack.path + name;
+}
+
+/* Find the record and the cell bits of level index, without decoding anything */
+inline bool level_pack_find (const struct level_pack& pack, int index, struct levelpack_record& record, const unsigned char*& bits, std::string& error)
+{
+	if(index < 0 || (uint32_t)index >= pack.count) {
+		error = level_pack_name(pack, index) + ": no such level";
+		return false;
+	}
+
+	uint64_t offset;
+	memcpy(&offset, pack.data + sizeof(struct levelpack_header) + (size_t)index*sizeof(uint64_t), sizeof(offset));
+	if(offset > pack.size || pack.size - offset < sizeof(record)) {
+		error = level_pack_name(pack, index) + ": truncated";
+		return false;
+	}
+	memcpy(&record, pack.data + offset, sizeof(record));
+	bits = pack.data + offset + sizeof(record);
+	if(pack.size - offset - sizeof(record) < levelpack_cell_bytes(record.width, record.height)) {
+		error = level_pack_name(pack, index) + ": truncated";
+		return false;
+	}
+	return true;
+}
+
+/* Decode level index of the pack, named <path>:<index> as text levels are */
+inline bool level_pack_get (const struct level_pack& pack, int index, struct level& l, std::string& error)
+{
+	struct levelpack_record record;
+	const unsigned char *bits;
+	l.name = level_pack_name(pack, index);
+	if(!level_pack_find(pack, index, record, bits, error))
+		return false;
+
+	l.width = record.width;
+	l.height = record.height;
+	l.start.x = record.start_x;
+	l.start.y = record.start_y;
+	l.start.orientation = record.start_orientation;
+	l.goal_x = record.goal_x;
+	l.goal_y = record.goal_y;
+	if(l.start.orientation > ORIENT_Y || l.start.x < 0 || l.start.x >= l.width || l.start.y < 0 || l.start.y >= l.height
+	   || l.goal_x < 0 || l.goal_x >= l.width || l.goal_y < 0 || l.goal_y >= l.height)
+	{
+		error = l.name + ": start or goal off the board";
+		return false;
+	}
+
+	size_t i, cells = (size_t)l.width*l.height;
+	l.cells.resize(cells);
+	for(i=0;i<cells;i++)
+		l.cells[i] = (bits[i>>3] >> (i&7)) & 1;
+	l.cells[l.goal_x*l.height + l.goal_y] = 2;
+	return true;
+}
+
+/* Write levels as a pack - returns false and sets error on failure */
+inline bool write_level_pack (const std::string& path, const std::vector<struct level>& levels, std::string& error)
+{
+	struct levelpack_header header;
+	memcpy(header.magic, LEVELPACK_MAGIC, 4);
+	header.version = LEVELPACK_VERSION;
+	header.count = levels.size();
+	header.reserved = 0;
+
+	// records follow the offset table back to back
+	std::vector<uint64_t> offsets(levels.size());
+	uint64_t offset = sizeof(header) + levels.size()*sizeof(uint64_t);
+	size_t i, j;
+	for(i=0;i<levels.size();i++)
+	{
+		const struct level& l = levels[i];
+		if(l.width > 0xffff || l.height > 0xffff) {
+			error = l.name + ": too big for a level pack";
+			return false;
+		}
+		offsets[i] = offset;
+		offset += levelpack_record_size(l.width, l.height);
+	}
+
+	FILE *out = fopen(path.c_str(), "wb");
+	if(out == NULL) {
+		error = path + ": can't write";
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, out);
+	if(!offsets.empty())
+		fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), out);
+
+	std::vector<unsigned char> bytes;
+	for(i=0;i<levels.size();i++)
+	{
+		const struct level& l = levels[i];
+		struct levelpack_record record;
+		memset(&record, 0, sizeof(record));
+		record.width = l.width;
+		record.height = l.height;
+		record.start_x = l.start.x;
+		record.start_y = l.start.y;
+		record.start_orientation = l.start.orientation;
+		record.goal_x = l.goal_x;
+		record.goal_y = l.goal_y;
+
+		bytes.assign(levelpack_record_size(l.width, l.height), 0);
+		memcpy(&bytes[0], &record, sizeof(record));
+		for(j=0;j<l.cells.size();j++)
+			if(l.cells[j] != 0)
+				bytes[sizeof(record) + (j>>3)] |= 1 << (j&7);
+		fwrite(&bytes[0], 1, bytes.size(), out);
+	}
+
+	bool ok = !ferror(out);
+	if(fclose(out) != 0)
+		ok = false;
+	if(!ok)
+		error = path + ": write failed";
+	return ok;
+}
+
+inline bool is_level_pack (const std::string& path)
+{
+	return path.size() >= 5 && path.compare(path.size()-5, 5, ".pack") == 0;
+}
+
+inline bool is_directory (const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Append every level of a text file, a pack, or every file of a directory in name order */
+inline bool load_levels (const std::string& path, std::vector<struct level>& levels, std::string& error)
+{
+	if(is_directory(path))
+	{
+		std::vector<std::string> names;
+		DIR *dir = opendir(path.c_str());
+		if(dir == NULL) {
+			error = path + ": can't open directory";
+			return false;
+		}
+		struct dirent *entry;
+		while((entry = readdir(dir)) != NULL)
+			if(entry->d_name[0] != '.')
+				names.push_back(entry->d_name);
+		closedir(dir);
+		std::sort(names.begin(), names.end());
+		for(size_t i=0;i<names.size();i++)
+			if(!load_levels(path + "/" + names[i], levels, error))
+				return false;
+		return true;
+	}
+
+	if(is_level_pack(path))
+	{
+		struct level_pack pack;
+		if(!level_pack_open(pack, path, error))
+			return false;
+		size_t first = levels.size();
+		levels.resize(first + pack.count);
+		bool ok = true;
+		for(uint32_t i=0;i<pack.count && ok;i++)
+			ok = level_pack_get(pack, i, levels[first+i], error);
+		level_pack_close(pack);
+		return ok;
+	}
+
+	std::ifstream in(path.c_str());
+	if(!in.is_open()) {
+		error = path + ": can't open";
+		return false;
+	}
+	return parse_levels(in, path, levels, error);
+}
+
+/* Load one level by name, <file>[:<index>] - from a pack only that level is read */
+inline bool load_level (const std::string& name, struct level& l, std::string& error)
+{
+	std::string path = name;
+	int index = 0;
+	size_t colon = name.rfind(':');
+	if(colon != std::string::npos && colon+1 < name.size() && name.find_first_not_of("0123456789", colon+1) == std::string::npos)
+	{
+		path = name.substr(0, colon);
+		index = atoi(name.c_str() + colon+1);
+	}
+
+	if(is_level_pack(path))
+	{
+		struct level_pack pack;
+		if(!level_pack_open(pack, path, error))
+			return false;
+		bool ok = level_pack_get(pack, index, l, error);
+		level_pack_close(pack);
+		return ok;
+	}
+
+	std::vector<struct level> levels;
+	if(!load_levels(path, levels, error))
+		return false;
+	if(index >= (int)levels.size()) {
+		error = name + ": no such level";
+		return false;
+	}
+	l = levels[index];
+	return true;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/* Level pack importer - converts hand authored text levels into one binary level pack */
+/* usage: packlevels -o <pack> <level file, pack or directory>... */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "simulation.h"
+#include "level.h"
+#include "levelpack.h"
+
+using namespace std;
+
+int main (int argc, char** argv)
+{
+	const char *output = NULL;
+	vector<string> inputs;
+	int i;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i], "-o")==0 && i+1<argc)
+			output = argv[++i];
+		else
+			inputs.push_back(argv[i]);
+	}
+	if(output == NULL || inputs.empty()) {
+		fprintf(stderr, "usage: %s -o <pack> <level file, pack or directory>...\n", argv[0]);
+		return 2;
+	}
+
+	vector<level> levels;
+	string error;
+	for(i=0;i<(int)inputs.size();i++)
+	{
+		if(!load_levels(inputs[i], levels, error)) {
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+	if(!write_level_pack(output, levels, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	fprintf(stderr, "%d levels written to %s\n", (int)levels.size(), output);
+	return 0;
+}
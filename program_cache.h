@@ -0,0 +1,133 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+/* On disk cache of linked GL program binaries, one file per key in the user's cache directory */
+/* ($XDG_CACHE_HOME, or ~/.cache, then PROGRAM_CACHE_DIR) - the same wherever the game is started */
+/* The key is a hash of everything the binary depends on - the shader sources and the driver */
+/* strings - so a changed shader or driver simply misses. A file that is cut short, or that */
+/* the driver turns down, is treated as a miss too and replaced by the next compile. */
+/* Nothing here touches GL: the caller gets and sets the binaries. */
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define PROGRAM_CACHE_DIR "bloxorz/shaders"
+#define PROGRAM_CACHE_MAGIC "BLXS"
+
+struct program_cache_header {
+	char magic[4];
+	uint32_t format; // binaryFormat from glGetProgramBinary
+	uint64_t key;
+	uint64_t length;
+};
+
+/* 64-bit FNV-1a, chained through h so several strings make one key */
+inline uint64_t program_cache_hash (const char *data, size_t size, uint64_t h = 14695981039346656037ULL)
+{
+	for(size_t i=0;i<size;i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/* Hash a string with its terminating zero, so "ab"+"c" and "a"+"bc" differ */
+inline uint64_t program_cache_hash (const std::string& text, uint64_t h = 14695981039346656037ULL)
+{
+	return program_cache_hash(text.c_str(), text.size()+1, h);
+}
+
+/* Directory the binaries live in - empty if there is no home to put it in, which turns the cache off */
+inline std::string program_cache_dir ()
+{
+	const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	if(xdg != NULL && xdg[0] == '/')
+		return std::string(xdg) + "/" PROGRAM_CACHE_DIR;
+	if(home != NULL && home[0] != 0)
+		return std::string(home) + "/.cache/" PROGRAM_CACHE_DIR;
+	return "";
+}
+
+inline std::string program_cache_path (uint64_t key)
+{
+	std::string dir = program_cache_dir();
+	if(dir.empty())
+		return "";
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+	return dir + name;
+}
+
+/* mkdir -p - each level fails harmlessly if it exists */
+inline void program_cache_mkdir (const std::string& dir)
+{
+	for(size_t i=1;i<=dir.size();i++)
+		if(i == dir.size() || dir[i] == '/')
+			mkdir(dir.substr(0, i).c_str(), 0755);
+}
+
+/* Binary stored for key - false if there is none or the file is damaged */
+inline bool program_cache_read (uint64_t key, uint32_t& format, std::vector<char>& binary)
+{
+	std::string path = program_cache_path(key);
+	if(path.empty())
+		return false;
+	FILE *in = fopen(path.c_str(), "rb");
+	if(in == NULL)
+		return false;
+	struct program_cache_header header;
+	bool ok = fread(&header, sizeof(header), 1, in) == 1
+		&& memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) == 0 && header.key == key
+		&& header.length > 0 && header.length < ((uint64_t)1 << 31);
+	if(ok)
+	{
+		binary.resize(header.length);
+		ok = fread(&binary[0], 1, binary.size(), in) == binary.size();
+		format = header.format;
+	}
+	fclose(in);
+	return ok;
+}
+
+/* Store a binary for key - written to a temporary file of this process and renamed into */
+/* place, so that another instance starting at the same time never reads or writes half a file */
+inline bool program_cache_write (uint64_t key, uint32_t format, const std::vector<char>& binary)
+{
+	std::string path = program_cache_path(key);
+	if(binary.empty() || path.empty())
+		return false;
+	program_cache_mkdir(program_cache_dir());
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+	std::string temporary = path + suffix;
+	FILE *out = fopen(temporary.c_str(), "wb");
+	if(out == NULL)
+		return false;
+	struct program_cache_header header;
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+	header.format = format;
+	header.key = key;
+	header.length = binary.size();
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(&binary[0], 1, binary.size(), out);
+	bool ok = !ferror(out);
+	if(fclose(out) != 0)
+		ok = false;
+	if(ok && rename(temporary.c_str(), path.c_str()) != 0)
+		ok = false;
+	if(!ok)
+		remove(temporary.c_str());
+	return ok;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+/* Bloxorz game rules - no GL or GLFW in here, so they can run without a window */
+/* Everything is a pure function of an explicit state: next = sim_step(state, input) */
+
+/* block orientation, as block_position.orientation */
+enum {
+	ORIENT_X = 0,     // lying down, covering x and x+1
+	ORIENT_UP = 1,    // standing on x,y
+	ORIENT_Y = 2      // lying down, covering y and y-1
+};
+
+/* moves, in the priority order sim_step picks between pending presses */
+enum {
+	MOVE_NONE = -1,
+	MOVE_LEFT = 0,
+	MOVE_RIGHT,
+	MOVE_DOWN,
+	MOVE_UP,
+	NUM_MOVES
+};
+
+struct sim_pose {
+	int x;
+	int y;
+	int orientation;
+};
+
+struct sim_input {
+	int press[NUM_MOVES]; // 1 for every key pressed since the last step
+};
+
+struct sim_state {
+	struct sim_pose pose;
+	int pending[NUM_MOVES]; // presses waiting for (or driving) a roll
+	int roll;               // move being animated, MOVE_NONE when at rest
+	float rotation;         // degrees rolled so far, 0..90
+};
+
+/* Where the block ends up after one move - the whole rule set of the game */
+inline struct sim_pose sim_move (struct sim_pose pose, int move)
+{
+	// dx, dy, new orientation for every [orientation][move]
+	static const int moves[3][NUM_MOVES][3] = {
+		/* ORIENT_X  */ { {-1,0,ORIENT_UP}, {2,0,ORIENT_UP}, {0,-1,ORIENT_X}, {0,1,ORIENT_X} },
+		/* ORIENT_UP */ { {-2,0,ORIENT_X}, {1,0,ORIENT_X}, {0,-1,ORIENT_Y}, {0,2,ORIENT_Y} },
+		/* ORIENT_Y  */ { {-1,0,ORIENT_Y}, {1,0,ORIENT_Y}, {0,-2,ORIENT_UP}, {0,1,ORIENT_UP} }
+	};
+	const int *m = moves[pose.orientation][move];
+	struct sim_pose next = { pose.x+m[0], pose.y+m[1], m[2] };
+	return next;
+}
+
+inline struct sim_state sim_start (struct sim_pose pose)
+{
+	struct sim_state state;
+	int i;
+	state.pose = pose;
+	for(i=0;i<NUM_MOVES;i++)
+		state.pending[i] = 0;
+	state.roll = MOVE_NONE;
+	state.rotation = 0;
+	return state;
+}
+
+inline struct sim_input sim_no_input ()
+{
+	struct sim_input input;
+	int i;
+	for(i=0;i<NUM_MOVES;i++)
+		input.press[i] = 0;
+	return input;
+}
+
+/* Advance the game by one tick, rolling roll_step degrees */
+/* Like the key flags, a press stays pending until a roll in that direction completes, and */
+/* the highest priority pending move is the one that rolls. roll_step >= 90 moves instantly. */
+inline struct sim_state sim_step (struct sim_state state, struct sim_input input, float roll_step)
+{
+	int i;
+	for(i=0;i<NUM_MOVES;i++)
+		state.pending[i] |= input.press[i];
+
+	state.roll = MOVE_NONE;
+	for(i=0;i<NUM_MOVES;i++)
+	{
+		if(state.pending[i])
+		{
+			state.roll = i;
+			break;
+		}
+	}
+	if(state.roll == MOVE_NONE)
+		return state;
+
+	state.rotation += roll_step;
+	if(state.rotation >= 90)
+	{
+		state.pose = sim_move(state.pose, state.roll);
+		state.pending[state.roll] = 0;
+		state.roll = MOVE_NONE;
+		state.rotation = 0;
+	}
+	return state;
+}
+
+/* A width x height board, cells[x*height + y] != 0 where there is floor - the layout of arena[x][y] */
+struct sim_board {
+	int width;
+	int height;
+	const int *cells;
+};
+
+inline bool sim_floor (const struct sim_board& board, int x, int y)
+{
+	if(x<0 || x>=board.width || y<0 || y>=board.height)
+		return false;
+	return board.cells[x*board.height + y] != 0;
+}
+
+/* True if every cell under the block is floor - otherwise the block falls */
+inline bool sim_supported (const struct sim_board& board, struct sim_pose pose)
+{
+	if(!sim_floor(board, pose.x, pose.y))
+		return false;
+	if(pose.orientation == ORIENT_X)
+		return sim_floor(board, pose.x+1, pose.y);
+	if(pose.orientation == ORIENT_Y)
+		return sim_floor(board, pose.x, pose.y-1);
+	return true;
+}
+
+/* True when the block isn't rolling and no press is waiting to roll it */
+inline bool sim_at_rest (const struct sim_state& state)
+{
+	int i;
+	if(state.roll != MOVE_NONE)
+		return false;
+	for(i=0;i<NUM_MOVES;i++)
+		if(state.pending[i])
+			return false;
+	return true;
+}
+
+/* Every move is undone by the opposite one */
+inline int sim_opposite (int move)
+{
+	return move ^ 1;
+}
+
+inline bool sim_same_pose (struct sim_pose a, struct sim_pose b)
+{
+	return a.x == b.x && a.y == b.y && a.orientation == b.orientation;
+}
+
+/* The state to draw at fraction alpha (0..1) of the way from tick prev to the following tick cur */
+inline struct sim_state sim_interpolate (struct sim_state prev, struct sim_state cur, float alpha)
+{
+	struct sim_state state = cur;
+	if(cur.roll == MOVE_NONE && prev.roll != MOVE_NONE)
+	{
+		// The roll finished on this tick - finish drawing it from the old pose
+		state = prev;
+		state.rotation = prev.rotation + (90 - prev.rotation)*alpha;
+	}
+	else if(cur.roll != MOVE_NONE && sim_same_pose(prev.pose, cur.pose))
+		state.rotation = prev.rotation + (cur.rotation - prev.rotation)*alpha;
+	return state;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+/* Shortest move sequence from a pose to standing on a goal cell */
+/* Breadth first search over the (x, y, orientation) states of a board - every move costs 1, */
+/* so BFS is optimal and visits each state once. All storage is sized once per board size */
+/* and reused between solves, nothing is allocated per node. */
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "simulation.h"
+#include "bitboard.h"
+
+struct solver {
+	int width, height;
+	std::vector<uint64_t> visited; // one bit per state
+	std::vector<uint64_t> queue;   // packed poses; every state is queued at most once, so this never wraps
+	std::vector<unsigned char> via; // move that first reached each state
+};
+
+inline int solver_state_id (const struct solver& s, struct sim_pose pose)
+{
+	return (pose.y*s.width + pose.x)*3 + pose.orientation;
+}
+
+inline struct sim_pose solver_state_pose (const struct solver& s, int id)
+{
+	struct sim_pose pose;
+	pose.orientation = id % 3;
+	id /= 3;
+	pose.x = id % s.width;
+	pose.y = id / s.width;
+	return pose;
+}
+
+/* Queue entries keep the pose itself so that popping one needs no division */
+inline uint64_t solver_pack (struct sim_pose pose)
+{
+	return ((uint64_t)(uint32_t)pose.y << 32) | ((uint32_t)pose.x << 2) | pose.orientation;
+}
+
+inline struct sim_pose solver_unpack (uint64_t packed)
+{
+	struct sim_pose pose;
+	pose.orientation = packed & 3;
+	pose.x = (uint32_t)packed >> 2;
+	pose.y = packed >> 32;
+	return pose;
+}
+
+/* Size the solver for a board, keeping the allocations when they are big enough */
+inline void solver_reset (struct solver& s, int width, int height)
+{
+	size_t states = (size_t)width*height*3;
+	s.width = width;
+	s.height = height;
+	if(s.queue.size() < states)
+	{
+		s.queue.resize(states);
+		s.via.resize(states);
+	}
+	s.visited.assign((states+63)/64, 0);
+}
+
+/* Number of moves from start to standing on goal_x, goal_y, or -1 if it can't be reached */
+/* If path is given it receives the moves (MOVE_LEFT..MOVE_UP) in order */
+inline int solve (struct solver& s, const struct bitboard& board, struct sim_pose start, int goal_x, int goal_y, std::vector<int> *path = NULL)
+{
+	solver_reset(s, board.width, board.height);
+	if(path)
+		path->clear();
+	if(!bitboard_supported(board, start) || !bitboard_floor(board, goal_x, goal_y))
+		return -1;
+
+	int head = 0, tail = 0, level_end, moves = 0;
+	int start_id = solver_state_id(s, start);
+	s.visited[start_id>>6] |= (uint64_t)1 << (start_id&63);
+	s.queue[tail++] = solver_pack(start);
+
+	int found = -1;
+	while(head < tail && found < 0)
+	{
+		// one BFS level per pass, so moves is the distance of every state in it
+		level_end = tail;
+		for(; head < level_end; head++)
+		{
+			struct sim_pose pose = solver_unpack(s.queue[head]);
+			if(pose.orientation == ORIENT_UP && pose.x == goal_x && pose.y == goal_y)
+			{
+				found = solver_state_id(s, pose);
+				break;
+			}
+			int legal = bitboard_successors(board, pose);
+			for(int move = 0; move < NUM_MOVES; move++)
+			{
+				if(!(legal & (1<<move)))
+					continue;
+				struct sim_pose next = sim_move(pose, move);
+				int next_id = solver_state_id(s, next);
+				uint64_t bit = (uint64_t)1 << (next_id&63);
+				if(s.visited[next_id>>6] & bit)
+					continue;
+				s.visited[next_id>>6] |= bit;
+				s.via[next_id] = move;
+				s.queue[tail++] = solver_pack(next);
+			}
+		}
+		if(found < 0)
+			moves++;
+	}
+	if(found < 0)
+		return -1;
+
+	if(path)
+	{
+		// walk back from the goal by undoing each move
+		path->resize(moves);
+		int id = found;
+		for(int i = moves-1; i >= 0; i--)
+		{
+			int move = s.via[id];
+			(*path)[i] = move;
+			id = solver_state_id(s, sim_move(solver_state_pose(s, id), sim_opposite(move)));
+		}
+	}
+	return moves;
+}
+
+#endif
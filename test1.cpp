@@ -1,26 +1,50 @@
 #include <iostream>
 #include <cmath>
-#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#ifndef __APPLE__
+#define EGL_NO_X11 // headless contexts need no display, so none of Xlib either
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "simulation.h"
+#include "bitboard.h"
+#include "solver.h"
+#include "level.h"
+#include "levelpack.h"
+#include "world.h"
+#include "frame_stats.h"
+#include "trace.h"
+#include "input_log.h"
+#include "input_queue.h"
+#include "frame_pacing.h"
+#include "program_cache.h"
+#include "shaders.h"
+
 using namespace std;
 
 struct VAO {
 	GLuint VertexArrayID;
-	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+	GLuint VertexBuffer; // interleaved x,y,z,r,g,b
+	GLuint IndexBuffer;
 
 	GLenum PrimitiveMode;
 	GLenum FillMode;
 	int NumVertices;
+	int NumIndices;
+	unsigned int EnabledAttribs; // bit i set once attribute i is enabled in this VAO
 };
 typedef struct VAO VAO;
 
@@ -28,39 +52,189 @@ struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID;
 } Matrices;
 
 GLuint programID;
 
-/* Function to load Shaders - Use it as it is */
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+/* Shadow copy of the GL state set by the draw functions - a call is only issued when the value changes */
+/* Enabled attributes are VAO state, so they are tracked in VAO::EnabledAttribs instead */
+struct RenderState {
+	GLuint vao;
+	GLuint program;
+	GLenum polygon_mode;
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	// counters for the frame in progress, and for the last complete frame
+	int calls_issued, calls_skipped;
+	int frame_calls_issued, frame_calls_skipped;
+} render_state = { 0, 0, GL_FILL, 0, 0, 0, 0 };
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
+void bindVertexArray (GLuint vao)
+{
+	if(render_state.vao == vao) {
+		render_state.calls_skipped++;
+		return;
+	}
+	glBindVertexArray (vao);
+	render_state.vao = vao;
+	render_state.calls_issued++;
+}
+
+void useProgram (GLuint program)
+{
+	if(render_state.program == program) {
+		render_state.calls_skipped++;
+		return;
+	}
+	glUseProgram (program);
+	render_state.program = program;
+	render_state.calls_issued++;
+}
+
+void setPolygonMode (GLenum mode)
+{
+	if(render_state.polygon_mode == mode) {
+		render_state.calls_skipped++;
+		return;
+	}
+	glPolygonMode (GL_FRONT_AND_BACK, mode);
+	render_state.polygon_mode = mode;
+	render_state.calls_issued++;
+}
+
+/* Starts a new frame of counters, keeping the previous frame's for reporting */
+void resetRenderStateCounters ()
+{
+	render_state.frame_calls_issued = render_state.calls_issued;
+	render_state.frame_calls_skipped = render_state.calls_skipped;
+	render_state.calls_issued = 0;
+	render_state.calls_skipped = 0;
+}
+
+/* Program binaries can be read back and reloaded - GL 4.1 or ARB_get_program_binary, */
+/* and a driver that offers at least one binary format (Mesa may offer none) */
+bool programBinarySupported ()
+{
+	GLint formats = 0;
+	if(!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+		return false;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+/* Cache key of a program - its sources and the driver that builds it */
+uint64_t programCacheKey (const std::string& vertex_code, const std::string& fragment_code)
+{
+	static const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	uint64_t key = program_cache_hash(vertex_code);
+	key = program_cache_hash(fragment_code, key);
+	for(int i=0;i<3;i++)
 	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+		const char *text = (const char*)glGetString(driver_strings[i]);
+		key = program_cache_hash(text ? text : "", key);
 	}
+	return key;
+}
+
+/* Program from the binary cache, or 0 if there is no usable binary for key */
+GLuint loadCachedProgram (uint64_t key)
+{
+	uint32_t format;
+	vector<char> binary;
+	if(!program_cache_read(key, format, binary))
+		return 0;
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, format, &binary[0], binary.size());
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if(Result != GL_TRUE)
+	{
+		// the driver turned it down (updated, or a different GPU) - compile instead
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+void saveCachedProgram (GLuint ProgramID, uint64_t key)
+{
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(ProgramID, length, NULL, &format, &binary[0]);
+	if(!program_cache_write(key, format, binary))
+		printf("Couldn't write the shader cache\n");
+}
+
+/* Directory to read the shaders from instead of the copies built in (--shader-dir), for */
+/* editing them without a rebuild; NULL uses the built in ones */
+const char *shader_dir = NULL;
+
+/* Source of the shader called name - the file of that name in shader_dir, read in one go, */
+/* or else the copy embedded at build time (shaders.h) */
+bool shaderSource (const char *name, std::string& code)
+{
+	if(shader_dir != NULL)
+	{
+		std::string path = std::string(shader_dir) + "/" + name;
+		FILE *in = fopen(path.c_str(), "rb");
+		long size = -1;
+		if(in != NULL && fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0)
+		{
+			code.resize(size);
+			if(size > 0 && fread(&code[0], 1, size, in) != (size_t)size)
+				size = -1;
+		}
+		if(in != NULL)
+			fclose(in);
+		if(size >= 0)
+			return true;
+		printf("Couldn't read %s, using the built in %s\n", path.c_str(), name);
+	}
+	for(int i=0;embedded_shaders[i].name!=NULL;i++)
+	{
+		if(strcmp(embedded_shaders[i].name, name) == 0) {
+			code = embedded_shaders[i].source;
+			return true;
+		}
+	}
+	printf("No shader called %s\n", name);
+	code.clear();
+	return false;
+}
+
+/* Function to load Shaders - Use it as it is */
+/* Linked programs are kept in the binary cache, and later runs load them from there */
+/* instead of compiling, as long as the sources and the driver are unchanged */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+
+	// The shaders are looked up by file name, built in unless --shader-dir is given
+	std::string VertexShaderCode;
+	shaderSource(vertex_file_path, VertexShaderCode);
 
-	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+	shaderSource(fragment_file_path, FragmentShaderCode);
+
+	bool use_cache = programBinarySupported() && !program_cache_dir().empty();
+	uint64_t cache_key = 0;
+	if(use_cache)
+	{
+		cache_key = programCacheKey(VertexShaderCode, FragmentShaderCode);
+		GLuint CachedProgramID = loadCachedProgram(cache_key);
+		if(CachedProgramID != 0)
+		{
+			printf("Loaded program %s + %s from the shader cache\n", vertex_file_path, fragment_file_path);
+			return CachedProgramID;
+		}
 	}
 
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -95,6 +269,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if(use_cache)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -104,6 +280,9 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 	fprintf(stdout, "%s\n", &ProgramErrorMessage[0]);
 
+	if(use_cache && Result == GL_TRUE)
+		saveCachedProgram(ProgramID, cache_key);
+
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
@@ -115,97 +294,263 @@ static void error_callback(int error, const char* description)
 	fprintf(stderr, "Error: %s\n", description);
 }
 
+/* Ends the main loop - the window is torn down after it, once the session is saved */
 void quit(GLFWwindow *window)
 {
-	glfwDestroyWindow(window);
-	glfwTerminate();
-	//    exit(EXIT_SUCCESS);
+	glfwSetWindowShouldClose(window, GL_TRUE);
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Generate VAO, VBO + element buffer and return VAO handle */
+/* vertex_buffer_data is interleaved: x,y,z,r,g,b per vertex */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, int numIndices, const GLuint* index_buffer_data, GLenum fill_mode=GL_FILL)
 {
 	struct VAO* vao = new struct VAO;
 	vao->PrimitiveMode = primitive_mode;
 	vao->NumVertices = numVertices;
+	vao->NumIndices = numIndices;
 	vao->FillMode = fill_mode;
+	vao->EnabledAttribs = 0;
 
 	// Create Vertex Array Object
 	// Should be done after CreateWindow and before any other GL calls
 	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices and colors
+	glGenBuffers (1, &(vao->IndexBuffer));  // EBO - indices
 
-	glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+	bindVertexArray (vao->VertexArrayID); // Bind the VAO 
+	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO 
+	glBufferData (GL_ARRAY_BUFFER, 6*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
 	glVertexAttribPointer(
 			0,                  // attribute 0. Vertices
 			3,                  // size (x,y,z)
 			GL_FLOAT,           // type
 			GL_FALSE,           // normalized?
-			0,                  // stride
+			6*sizeof(GLfloat),  // stride
 			(void*)0            // array buffer offset
 			);
-
-	glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
 	glVertexAttribPointer(
 			1,                  // attribute 1. Color
 			3,                  // size (r,g,b)
 			GL_FLOAT,           // type
 			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
+			6*sizeof(GLfloat),  // stride
+			(void*)(3*sizeof(GLfloat)) // array buffer offset
 			);
 
+	// The element buffer binding is recorded in the VAO
+	glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer);
+	glBufferData (GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLuint), index_buffer_data, GL_STATIC_DRAW);
+
 	return vao;
 }
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+/* Release the VBOs and VAO created by create3DObject */
+void delete3DObject (struct VAO* vao)
+{
+	glDeleteBuffers (1, &(vao->VertexBuffer));
+	glDeleteBuffers (1, &(vao->IndexBuffer));
+	glDeleteVertexArrays (1, &(vao->VertexArrayID));
+	if(render_state.vao == vao->VertexArrayID)
+		render_state.vao = 0;
+	delete vao;
+}
+
+/* Enable a vertex attribute of vao - vao must be bound */
+void enableVertexAttrib (struct VAO* vao, GLuint index)
+{
+	if(vao->EnabledAttribs & (1u<<index)) {
+		render_state.calls_skipped++;
+		return;
+	}
+	glEnableVertexAttribArray(index);
+	vao->EnabledAttribs |= 1u<<index;
+	render_state.calls_issued++;
+}
+
+/* Transforms uniform block - VP plus one model matrix per object, in std140 layout */
+/* Must match MAX_OBJECTS in the vertex shaders */
+#define MAX_OBJECTS 16
+#define TRANSFORMS_BINDING 0
+
+enum { OBJECT_FLOOR, OBJECT_BLOCK, NUM_OBJECTS };
+
+struct TransformBlock {
+	glm::mat4 VP;
+	glm::mat4 model[MAX_OBJECTS];
+} transform_block;
+
+GLuint TransformBuffer;   // UBO holding transform_block
+GLuint ObjectIndexBuffer; // 0,1,2.. - each VAO reads its own entry as vertex attribute 4
+
+void createTransformBuffer ()
 {
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-	for (int i=0; i<numVertices; i++) {
-		color_buffer_data [3*i] = red;
-		color_buffer_data [3*i + 1] = green;
-		color_buffer_data [3*i + 2] = blue;
+	int i;
+	GLint object_indices[MAX_OBJECTS];
+	for(i=0;i<MAX_OBJECTS;i++)
+	{
+		object_indices[i] = i;
+		transform_block.model[i] = glm::mat4(1.0f);
 	}
+	transform_block.VP = glm::mat4(1.0f);
+
+	glGenBuffers (1, &TransformBuffer);
+	glBindBuffer (GL_UNIFORM_BUFFER, TransformBuffer);
+	glBufferData (GL_UNIFORM_BUFFER, sizeof(transform_block), &transform_block, GL_DYNAMIC_DRAW);
+	glBindBufferBase (GL_UNIFORM_BUFFER, TRANSFORMS_BINDING, TransformBuffer);
+
+	glGenBuffers (1, &ObjectIndexBuffer);
+	glBindBuffer (GL_ARRAY_BUFFER, ObjectIndexBuffer);
+	glBufferData (GL_ARRAY_BUFFER, sizeof(object_indices), object_indices, GL_STATIC_DRAW);
+}
+
+/* Point the objectIndex attribute of vao at model[index] */
+/* The huge divisor makes every vertex and instance read the same entry, so no per draw uniform is needed */
+void setObjectIndex (struct VAO* vao, int index)
+{
+	bindVertexArray (vao->VertexArrayID);
+	glBindBuffer (GL_ARRAY_BUFFER, ObjectIndexBuffer);
+	glVertexAttribIPointer(4, 1, GL_INT, 0, (void*)(index*sizeof(GLint)));
+	glVertexAttribDivisor(4, 0x40000000);
+	enableVertexAttrib(vao, 4);
+}
 
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+/* Send the part of transform_block used this frame in a single update */
+void uploadTransforms ()
+{
+	glBindBuffer (GL_UNIFORM_BUFFER, TransformBuffer);
+	glBufferSubData (GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4)*(1+NUM_OBJECTS), &transform_block);
+}
+
+/* Attach the Transforms block of a program to the shared binding point */
+void bindTransformBlock (GLuint program)
+{
+	GLuint block_index = glGetUniformBlockIndex(program, "Transforms");
+	if(block_index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block_index, TRANSFORMS_BINDING);
 }
 
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
 	// Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+	setPolygonMode (vao->FillMode);
 
-	// Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
+	// Bind the VAO to use - it already records the VBO and attribute layout
+	bindVertexArray (vao->VertexArrayID);
 
 	// Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
+	enableVertexAttrib(vao, 0);
 	// Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+	enableVertexAttrib(vao, 1);
 
 	// Draw the geometry !
-	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+	glDrawElements(vao->PrimitiveMode, vao->NumIndices, GL_UNSIGNED_INT, (void*)0);
+}
+
+/* Render numInstances copies of the VAO in one call - per instance data must already be attached */
+void draw3DObjectInstanced (struct VAO* vao, int numInstances)
+{
+	setPolygonMode (vao->FillMode);
+	bindVertexArray (vao->VertexArrayID);
+	glDrawElementsInstanced(vao->PrimitiveMode, vao->NumIndices, GL_UNSIGNED_INT, (void*)0, numInstances);
 }
 
 /**************************
  * Customizable functions *
  **************************/
 
-int left_press=0,right_press=0,up_press=0,down_press=0;
+/* Arrow presses waiting for the block, oldest first - filled by keyboard, drained by check_key_functions */
+struct input_queue move_queue;
+#define DEFAULT_LOOKAHEAD 3 // moves buffered ahead of the block (--lookahead)
 int arena[15][10];
-glm::mat4 MVP,VP;
+glm::mat4 VP;
+
+/* Per tile instance data for the floor, kept on the GPU until arena changes */
+struct FloorInstances {
+	GLuint InstanceBuffer;
+	GLuint ProgramID;
+	int NumInstances;
+	int Capacity;
+	bool dirty;
+} floor_instances;
+
+/* The whole floor merged into one world space mesh, rebuilt by bakeFloor when arena changes */
+VAO *floor_mesh = NULL;
+bool floor_mesh_dirty = true;
+
+/* FLOOR_BAKED draws floor_mesh, FLOOR_INSTANCED draws the tile VAO once per live cell */
+enum { FLOOR_BAKED, FLOOR_INSTANCED } floor_mode = FLOOR_BAKED;
+
+bool show_render_stats = false;
+
+/* When nothing is moving and nothing has changed, main sleeps in glfwWaitEventsTimeout instead */
+/* of drawing the same frame again; any input or window event wakes it (--no-idle to always draw) */
+#define IDLE_WAIT_TIMEOUT 0.5 // seconds, so timedUpdate still runs every 0.5 s while idle
+bool idle_rendering = true;
+
+/* Frame pacing mode (--pacing vsync|uncapped|adaptive|<fps>), vsync by default */
+struct frame_pacer pacer = { PACING_VSYNC, 0, 0, 0 };
+bool redraw_requested = true; // something other than the block changed since the last frame
+
+/* Time spent in each phase of the main loop, reported every 0.5 s to --frame-stats <file> */
+/* and, while T is toggled on, as frame p50/p99/max in the window title */
+struct frame_stats frame_timing;
+FILE *frame_stats_file = NULL;
+bool show_frame_stats = false;
+
+/* Zones of the main loop are always traced into a ring of recent events; X writes them out */
+/* as Chrome trace JSON to trace_path, and --trace <file> also writes them when the game exits */
+const char *trace_path = "trace.json";
+bool trace_on_exit = false;
+
+/* GL_TIME_ELAPSED queries around the floor and block passes, one pair per frame in a ring */
+/* A frame's results are collected GPU_TIMER_FRAMES frames later, when they are long done, */
+/* so reading them never waits on the GPU; any still not ready are dropped rather than waited for */
+#define GPU_TIMER_FRAMES 4
+enum { GPU_PASS_TILES, GPU_PASS_BLOCK, NUM_GPU_PASSES };
+struct GpuTimers {
+	GLuint Queries[GPU_TIMER_FRAMES][NUM_GPU_PASSES];
+	bool pending[GPU_TIMER_FRAMES]; // queries issued and not read back yet
+	int frame;                      // ring slot of the frame being drawn
+} gpu_timers;
+
+/* Transforms kept between frames - each one is only recomputed when its dirty flag is set */
+struct TransformCache {
+	bool camera_dirty; // view or projection changed (camera, reshapeWindow)
+	bool block_dirty;  // block pose changed
+	bool upload_dirty; // transform_block changed since it was last sent
+} transforms = { true, true, true };
+
+/* View frustum planes (left, right, bottom, top, near, far) taken from VP whenever it changes */
+/* Floor meshes whose bounding box lies wholly outside one plane are not drawn */
+struct Frustum {
+	glm::vec4 planes[6];
+	bool enabled;
+	int drawn, culled; // floor meshes in the last frame
+} frustum = { {}, true, 0, 0 };
+
+/* Headless run (--headless <frames>): draws into an offscreen framebuffer, one simulation */
+/* tick per frame, as fast as it can, and the program exits after the given number of frames */
+/* - for benchmarks and image checks on machines with no display. By default the context */
+/* comes from EGL on Mesa's surfaceless platform and GLFW is never started, so no X11 or */
+/* Wayland server is needed. --context window|egl|osmesa uses a hidden GLFW window instead, */
+/* which does need a display (Xvfb on a build machine). */
+struct Headless {
+	int frames;             // 0 for a normal windowed run
+	const char *snapshot;   // --snapshot <file.ppm> - the last frame is written here
+	bool surfaceless;       // no window at all - false for --context window|egl|osmesa
+	int context_api;        // GLFW context API of the hidden window, 0 for the platform default
+	void *egl_display;      // EGLDisplay and EGLContext of a surfaceless run
+	void *egl_context;
+	GLuint Framebuffer;
+	GLuint ColorBuffer;
+	GLuint DepthBuffer;
+	int width, height;
+} headless = { 0, NULL, true, 0, NULL, NULL, 0, 0, 0, 0, 0 };
+
+/* Bounds of floor_mesh, set by bakeFloor */
+glm::vec3 floor_mesh_min, floor_mesh_max;
 
 struct block_positions{
 	int x1;
@@ -216,26 +561,92 @@ struct block_positions{
 };
 
 struct block_positions block_position;
+
+/* Game state, advanced by check_key_functions at a fixed rate - block_position mirrors it for drawing */
+/* previous_state is the state one tick earlier, so frames between ticks can be interpolated */
+struct sim_state game_state, previous_state, drawn_state;
+
+/* Simulation ticks per second, independent of the frame rate (--tick-rate) */
+double sim_tick_rate = 60;
+
+/* Ticks run since the game started - logged moves are stamped with it */
+uint32_t sim_tick = 0;
+
+/* --record <file> logs every move handed to the simulation. --replay <file> feeds a log back */
+/* in place of the keyboard at --replay-speed times real time, or with --no-render as fast as */
+/* the simulation goes without opening a window; the game exits when the replay is over */
+struct InputLog {
+	FILE *record;
+	double record_start;
+	vector<struct input_event> events;
+	size_t next;  // next event to replay
+	bool replaying;
+	double speed;
+	bool render;
+} input_log = { NULL, 0, vector<struct input_event>(), 0, false, 1, true };
+
+/* Cell the block has to stand on, marked 2 in arena */
+int goal_x, goal_y;
+struct sim_pose start_pose;
+struct solver hint_solver;
+
+/* Level picked with --level <file>[:<index>], or width 0 for the built in board */
+struct level current_level;
+
+/* arena as a bitboard, for the game over test and the solver - rebuilt by initialiseArena */
+struct bitboard arena_bits;
+
+/* Streamed world picked with --world <seed> or --world <file>[:<index>], played instead of arena */
+/* Chunks around the block are kept resident, each with its own baked floor mesh, and the least */
+/* recently used one is dropped to make room - memory and frame time don't grow with the world */
+#define WORLD_VIEW_RADIUS 2      // chunks drawn on each side of the block's chunk
+#define WORLD_CHUNK_SLOTS 36     // resident chunks - the 5x5 view plus room to move without thrashing
+#define WORLD_BAKES_PER_FRAME 2  // new chunk meshes built per frame, nearest first
+bool world_mode = false;
+struct world_source world;
+struct chunk_cache world_chunks;
+
+/* Floor mesh of each chunk cache slot, for the chunk cx, cy it was baked from */
+struct ChunkMesh {
+	VAO *mesh;
+	int cx, cy;
+	bool baked;
+	glm::vec3 bounds_min, bounds_max; // world space, for frustum culling
+};
+vector<ChunkMesh> chunk_meshes;
+bool chunk_bakes_pending = false; // chunks in view were left unbaked last frame - keeps the scene from going idle
+
+/* Point the camera looks at - the block in a world, the origin otherwise */
+glm::vec3 camera_focus(0,0,0);
+
+/* Print the length of the shortest solution from the current pose, and its first move */
+void show_hint()
+{
+	static const char *move_names[NUM_MOVES] = { "left", "right", "down", "up" };
+	// arena_bits is never built for a streamed world, so there is nothing to search
+	if(world_mode) {
+		printf("Hint: not available in a streamed world\n");
+		return;
+	}
+	vector<int> path;
+	int moves = solve(hint_solver, arena_bits, game_state.pose, goal_x, goal_y, &path);
+	if(moves < 0)
+		printf("Hint: the goal can't be reached from here\n");
+	else if(moves == 0)
+		printf("Hint: you are on the goal\n");
+	else
+		printf("Hint: %d moves to the goal, next move %s\n", moves, move_names[path[0]]);
+}
+
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
 void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	// Function is called first on GLFW_PRESS.
+	redraw_requested = true;
 
 	if (action == GLFW_RELEASE) {
 		switch (key) {
-			case GLFW_KEY_UP:
-				up_press=0;
-				break;
-			case GLFW_KEY_LEFT:
-				left_press=0;
-				break;
-			case GLFW_KEY_DOWN:
-				down_press=0;
-				break;
-			case GLFW_KEY_RIGHT:
-				right_press=0;
-				break;
 			case GLFW_KEY_C:
 				break;
 			case GLFW_KEY_P:
@@ -250,16 +661,44 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 	else if (action == GLFW_PRESS) {
 		switch (key) {
 			case GLFW_KEY_UP:
-				up_press=1;
+				input_queue_push(move_queue, MOVE_UP);
 				break;
 			case GLFW_KEY_LEFT:
-				left_press=1;
+				input_queue_push(move_queue, MOVE_LEFT);
 				break;
 			case GLFW_KEY_DOWN:
-				down_press=1;
+				input_queue_push(move_queue, MOVE_DOWN);
 				break;
 			case GLFW_KEY_RIGHT:
-				right_press=1;
+				input_queue_push(move_queue, MOVE_RIGHT);
+				break;
+			case GLFW_KEY_X:
+				// export the recent trace
+				if(trace_write(trace_path))
+					printf("Trace written to %s\n", trace_path);
+				else
+					printf("%s: can't write the trace\n", trace_path);
+				break;
+			case GLFW_KEY_T:
+				// frame times in the window title
+				show_frame_stats = !show_frame_stats;
+				if(!show_frame_stats)
+					glfwSetWindowTitle(window, "Sample OpenGL 3.3 Application");
+				break;
+			case GLFW_KEY_C:
+				// frustum culling of the floor on/off
+				frustum.enabled = !frustum.enabled;
+				break;
+			case GLFW_KEY_F:
+				// switch between the baked and the instanced floor
+				floor_mode = (floor_mode == FLOOR_BAKED) ? FLOOR_INSTANCED : FLOOR_BAKED;
+				break;
+			case GLFW_KEY_H:
+				show_hint();
+				break;
+			case GLFW_KEY_S:
+				// print GL calls issued/skipped by the render state cache
+				show_render_stats = !show_render_stats;
 				break;
 			case GLFW_KEY_ESCAPE:
 				quit(window);
@@ -307,7 +746,8 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 	int fbwidth=width, fbheight=height;
 	/* With Retina display on Mac OS X, GLFW's FramebufferSize
 	   is different from WindowSize */
-	glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+	if(window != NULL) // NULL for a surfaceless headless run, where the offscreen target is the size asked for
+		glfwGetFramebufferSize(window, &fbwidth, &fbheight);
 
 	GLfloat fov = 90.0f;
 
@@ -325,504 +765,479 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 	// Ortho projection for 2D views
 	Matrices.projection = glm::ortho(-9.0f, 9.0f, -6.0f, 6.0f, 0.1f, 500.0f);
 	//	Matrices.projection = glm::perspective (2.0f, 1.5f, 0.1f, 7000.0f);
+
+	// VP has to be rebuilt for the new projection
+	transforms.camera_dirty = true;
 }
 
 VAO  *block_vertical,*block_horizontal1,*block_horizontal2,*tile;
 
-void createBlockVertical ()
-{
-	// GL3 accepts only Triangles. Quads are not supported
-	static const GLfloat vertex_buffer_data [] = {
-		0,0,0, // vertex 1
-		1,0,0, // vertex 2
-		0,2,0, // vertex 3
-		1,2,0, // vertex 3
-		1,0,0, // vertex 
-		0,2,0,
-
-		0,0,1,
-		1,0,1,
-		0,2,1,
-		1,2,1,
-		1,0,1,
-		0,2,1,
-
-		0,0,0,
-		0,2,0,
-		0,0,1,
-		0,2,1,
-		0,2,0,
-		0,0,1,
-
-		1,0,0,
-		1,2,0,
-		1,0,1,
-		1,2,1,
-		1,2,0,
-		1,0,1,
-
-		0,0,0,
-		1,0,0,
-		0,0,1,
-		1,0,1,
-		1,0,0,
-		0,0,1,
-
-		0,2,0,
-		1,2,0,
-		0,2,1,
-		1,2,1,
-		1,2,0,
-		0,2,1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
+/* Faces of a unit cube as corners a,b,c,d - drawn as triangles (a,b,c) and (d,b,c) */
+/* Order is z=0, z=1, x=0, x=1, y=0, y=1 */
+static const GLfloat cuboid_faces[6][4][3] = {
+	{ {0,0,0}, {1,0,0}, {0,1,0}, {1,1,0} },
+	{ {0,0,1}, {1,0,1}, {0,1,1}, {1,1,1} },
+	{ {0,0,0}, {0,1,0}, {0,0,1}, {0,1,1} },
+	{ {1,0,0}, {1,1,0}, {1,0,1}, {1,1,1} },
+	{ {0,0,0}, {1,0,0}, {0,0,1}, {1,0,1} },
+	{ {0,1,0}, {1,1,0}, {0,1,1}, {1,1,1} }
+};
+#define CUBOID_ALL_FACES 0x3f
 
-	};
+static const GLfloat block_dark[3] = { 0.1, 0.1, 0.1 }, block_light[3] = { 0.3, 0.2, 0.1 };
+static const GLfloat tile_dark[3] = { 0.3, 0.3, 0.3 }, tile_light[3] = { 0.6, 0.6, 0.6 };
+static const GLfloat goal_dark[3] = { 0.12, 0.3, 0.12 }, goal_light[3] = { 0.24, 0.6, 0.24 };
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	block_vertical = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+/* Append a size.x * size.y * size.z box at origin to an interleaved vertex list and its index list */
+/* 4 vertices per face; corners a and d get the dark color, b and c the light one */
+void appendCuboid (vector<GLfloat>& vertices, vector<GLuint>& indices, glm::vec3 origin, glm::vec3 size, const GLfloat dark[3], const GLfloat light[3], int faces=CUBOID_ALL_FACES)
+{
+	int f,corner;
+	for(f=0;f<6;f++)
+	{
+		if(!(faces & (1<<f)))
+			continue;
+		GLuint base = vertices.size()/6;
+		for(corner=0;corner<4;corner++)
+		{
+			const GLfloat *color = (corner==0 || corner==3) ? dark : light;
+			vertices.push_back(origin.x + cuboid_faces[f][corner][0]*size.x);
+			vertices.push_back(origin.y + cuboid_faces[f][corner][1]*size.y);
+			vertices.push_back(origin.z + cuboid_faces[f][corner][2]*size.z);
+			vertices.insert(vertices.end(), color, color+3);
+		}
+		indices.push_back(base);
+		indices.push_back(base+1);
+		indices.push_back(base+2);
+		indices.push_back(base+3);
+		indices.push_back(base+1);
+		indices.push_back(base+2);
+	}
 }
 
-void createBlockHorizontal1 ()
+/* 24 vertex, 36 index box with one corner at the origin */
+VAO* createCuboid (glm::vec3 size, const GLfloat dark[3], const GLfloat light[3])
 {
-	// GL3 accepts only Triangles. Quads are not supported
-	static const GLfloat vertex_buffer_data [] = {
-		0,0,0, 
-		2,0,0, 
-		0,1,0, 
-		2,1,0, 
-		2,0,0, 
-		0,1,0,
-
-		0,0,1,
-		2,0,1,
-		0,1,1,
-		2,1,1,
-		2,0,1,
-		0,1,1,
-
-		0,0,0,
-		0,1,0,
-		0,0,1,
-		0,1,1,
-		0,1,0,
-		0,0,1,
-
-		2,0,0,
-		2,1,0,
-		2,0,1,
-		2,1,1,
-		2,1,0,
-		2,0,1,
-
-		0,0,0,
-		2,0,0,
-		0,0,1,
-		2,0,1,
-		2,0,0,
-		0,0,1,
-
-		0,1,0,
-		2,1,0,
-		0,1,1,
-		2,1,1,
-		2,1,0,
-		0,1,1
-	};
+	vector<GLfloat> vertices;
+	vector<GLuint> indices;
+	appendCuboid(vertices, indices, glm::vec3(0,0,0), size, dark, light);
+	return create3DObject(GL_TRIANGLES, vertices.size()/6, &vertices[0], indices.size(), &indices[0], GL_FILL);
+}
 
-	static const GLfloat color_buffer_data [] = {
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
+void createBlockVertical ()
+{
+	block_vertical = createCuboid(glm::vec3(1,2,1), block_dark, block_light);
+	setObjectIndex(block_vertical, OBJECT_BLOCK);
+}
 
-	};
+void createBlockHorizontal1 ()
+{
+	block_horizontal1 = createCuboid(glm::vec3(2,1,1), block_dark, block_light);
+	setObjectIndex(block_horizontal1, OBJECT_BLOCK);
+}
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	block_horizontal1 = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+void createBlockHorizontal2 ()
+{
+	block_horizontal2 = createCuboid(glm::vec3(1,1,2), block_dark, block_light);
+	setObjectIndex(block_horizontal2, OBJECT_BLOCK);
 }
 
+void createTile()
+{
+	tile = createCuboid(glm::vec3(1,0.2,1), tile_dark, tile_light);
+}
 
-void createBlockHorizontal2 ()
+/* Attach a per instance buffer (offset + color) to the tile VAO so that the whole floor is one draw call */
+/* Must be called after createTile */
+void createFloorInstances ()
 {
-	// GL3 accepts only Triangles. Quads are not supported
-	static const GLfloat vertex_buffer_data [] = {
-		0,0,0, 
-		1,0,0, 
-		0,1,0, 
-		1,1,0, 
-		1,0,0, 
-		0,1,0,
-
-		0,0,2,
-		1,0,2,
-		0,1,2,
-		1,1,2,
-		1,0,2,
-		0,1,2,
-
-		0,0,0,
-		0,1,0,
-		0,0,2,
-		0,1,2,
-		0,1,0,
-		0,0,2,
-
-		1,0,0,
-		1,1,0,
-		1,0,2,
-		1,1,2,
-		1,1,0,
-		1,0,2,
-
-		0,0,0,
-		1,0,0,
-		0,0,2,
-		1,0,2,
-		1,0,0,
-		0,0,2,
-
-		0,1,0,
-		1,1,0,
-		0,1,2,
-		1,1,2,
-		1,1,0,
-		0,1,2
-	};
+	floor_instances.NumInstances = 0;
+	floor_instances.Capacity = 0;
+	floor_instances.dirty = true;
 
-	static const GLfloat color_buffer_data [] = {
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
-
-		0.1,0.1,0.1,
-		0.3,0.2,0.1, 
-		0.3,0.2,0.1, 
-		0.1,0.1,0.1,
-		0.3,0.2,0.1,
-		0.3,0.2,0.1, 
+	glGenBuffers (1, &(floor_instances.InstanceBuffer));
 
-	};
+	bindVertexArray (tile->VertexArrayID);
+	glBindBuffer (GL_ARRAY_BUFFER, floor_instances.InstanceBuffer);
+
+	// attribute 2 - tile offset, attribute 3 - tile color; interleaved, advanced once per instance
+	enableVertexAttrib(tile, 2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0);
+	glVertexAttribDivisor(2, 1);
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	block_horizontal2 = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+	enableVertexAttrib(tile, 3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(3*sizeof(GLfloat)));
+	glVertexAttribDivisor(3, 1);
+
+	// Enable the mesh attributes too, the floor is never drawn through draw3DObject
+	enableVertexAttrib(tile, 0);
+	enableVertexAttrib(tile, 1);
 }
 
-void createTile()
+/* Rewrite the instance buffer from arena - only called when arena has changed */
+void updateFloorInstances ()
 {
-	static const GLfloat vertex_buffer_data [] = {
-		0,0,0, // vertex 1
-		1,0,0, // vertex 2
-		0,0.2,0, // vertex 3
-		1,0.2,0, // vertex 3
-		1,0,0, // vertex 4
-		0,0.2,0,
-
-		0,0,1,
-		1,0,1,
-		0,0.2,1,
-		1,0.2,1,
-		1,0,1,
-		0,0.2,1,
-
-		0,0,0,
-		0,0.2,0,
-		0,0,1,
-		0,0.2,1,
-		0,0.2,0,
-		0,0,1,
-
-		1,0,0,
-		1,0.2,0,
-		1,0,1,
-		1,0.2,1,
-		1,0.2,0,
-		1,0,1,
-
-		0,0,0,
-		1,0,0,
-		0,0,1,
-		1,0,1,
-		1,0,0,
-		0,0,1,
-
-		0,0.2,0,
-		1,0.2,0,
-		0,0.2,1,
-		1,0.2,1,
-		1,0.2,0,
-		0,0.2,1
-	};
+	static vector<GLfloat> instance_data;
+	float x_start=-7.5,z_start=5;
+	int i,j;
 
-	static const GLfloat color_buffer_data [] = {
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6, 
-		0.3,0.3,0.3,
-		0.6,0.6,0.6, 
-		0.6,0.6,0.6
+	instance_data.clear();
+	for(i=0;i<15;i++)
+	{
+		z_start=5;
+		for(j=0;j<10;j++)
+		{
+			if(arena[i][j]!=0)
+			{
+				instance_data.push_back(x_start);
+				instance_data.push_back(0);
+				instance_data.push_back(z_start);
+				if(arena[i][j]==2)
+				{
+					// goal tile in green
+					instance_data.push_back(0.4);
+					instance_data.push_back(1);
+					instance_data.push_back(0.4);
+				}
+				else
+				{
+					instance_data.push_back(1);
+					instance_data.push_back(1);
+					instance_data.push_back(1);
+				}
+			}
+			z_start-=1;
+		}
+		x_start+=1;
+	}
+	floor_instances.NumInstances = instance_data.size()/6;
 
-	};
+	glBindBuffer (GL_ARRAY_BUFFER, floor_instances.InstanceBuffer);
+	if(floor_instances.NumInstances > floor_instances.Capacity)
+	{
+		// Grow (and orphan) the buffer, otherwise just overwrite in place
+		floor_instances.Capacity = floor_instances.NumInstances;
+		glBufferData (GL_ARRAY_BUFFER, instance_data.size()*sizeof(GLfloat), &instance_data[0], GL_STATIC_DRAW);
+	}
+	else if(floor_instances.NumInstances > 0)
+		glBufferSubData (GL_ARRAY_BUFFER, 0, instance_data.size()*sizeof(GLfloat), &instance_data[0]);
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	tile = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
+	floor_instances.dirty = false;
 }
 
-void check_key_functions()
+int arenaCell (int i, int j)
 {
-	if(left_press==1)
+	if(world_mode)
+		return chunk_cache_cell(world_chunks, world, i, j);
+	if(i<0 || i>=15 || j<0 || j>=10)
+		return 0;
+	return arena[i][j];
+}
+
+/* Merge the live tiles of the i0..i0+w, j0..j0+h block of arena into one world space mesh */
+/* Side faces shared with a neighbouring tile can never be seen and are dropped */
+/* bounds_min and bounds_max, if given, receive the mesh's bounding box */
+VAO* bakeFloorMesh (int i0, int j0, int w, int h, glm::vec3 *bounds_min=NULL, glm::vec3 *bounds_max=NULL)
+{
+	// Cell that hides each face of cuboid_faces, relative to the tile; 0,0 for faces that are always kept
+	static const int face_neighbour[6][2] = { {0,1}, {0,-1}, {-1,0}, {1,0}, {0,0}, {0,0} };
+
+	vector<GLfloat> vertices;
+	vector<GLuint> indices;
+	int i,j,f;
+	for(i=i0;i<i0+w;i++)
 	{
-		if(block_position.orientation==1)
+		for(j=j0;j<j0+h;j++)
 		{
-			block_position.orientation=0;
-			block_position.x1-=2;
-		}
-		else if(block_position.orientation==0)
-		{
-			block_position.orientation=1;
-			block_position.x1-=1;
-		}
-		else
-		{
-			block_position.x1-=1;
+			if(arenaCell(i,j)==0)
+				continue;
+			int faces=0;
+			for(f=0;f<6;f++)
+			{
+				int di=face_neighbour[f][0], dj=face_neighbour[f][1];
+				if((di==0 && dj==0) || arenaCell(i+di,j+dj)==0)
+					faces |= 1<<f;
+			}
+			if(arenaCell(i,j)==2)
+				appendCuboid(vertices, indices, glm::vec3(-7.5+i,0,5-j), glm::vec3(1,0.2,1), goal_dark, goal_light, faces);
+			else
+				appendCuboid(vertices, indices, glm::vec3(-7.5+i,0,5-j), glm::vec3(1,0.2,1), tile_dark, tile_light, faces);
 		}
-		left_press=0;
 	}
-	if(right_press==1)
+	if(vertices.empty())
+		return NULL;
+	if(bounds_min != NULL && bounds_max != NULL)
 	{
-		if(block_position.orientation==1)
+		glm::vec3 lo(vertices[0], vertices[1], vertices[2]), hi = lo;
+		for(size_t v=6;v<vertices.size();v+=6)
 		{
-			block_position.orientation=0;
-			block_position.x1+=1;
-		}
-		else if(block_position.orientation==0)
-		{	
-			block_position.orientation=1;
-			block_position.x1+=2;
-		}
-		else
-		{
-			block_position.x1+=1;
+			for(int k=0;k<3;k++)
+			{
+				lo[k] = min(lo[k], vertices[v+k]);
+				hi[k] = max(hi[k], vertices[v+k]);
+			}
 		}
-		right_press=0;
+		*bounds_min = lo;
+		*bounds_max = hi;
+	}
+	return create3DObject(GL_TRIANGLES, vertices.size()/6, &vertices[0], indices.size(), &indices[0], GL_FILL);
+}
+
+/* Pull the frustum planes out of a view-projection matrix: a point p is inside when */
+/* -w <= x,y,z <= w for (x,y,z,w) = vp*p, i.e. row3 + rowN and row3 - rowN are both >= 0 */
+void updateFrustum (const glm::mat4& vp)
+{
+	glm::vec4 row3(vp[0][3], vp[1][3], vp[2][3], vp[3][3]);
+	for(int n=0;n<3;n++)
+	{
+		glm::vec4 row(vp[0][n], vp[1][n], vp[2][n], vp[3][n]);
+		frustum.planes[2*n] = row3 + row;
+		frustum.planes[2*n+1] = row3 - row;
 	}
-	if(down_press==1)
+}
+
+/* False when the box is wholly outside the frustum - its corner furthest along a plane's normal is behind it */
+bool boxInFrustum (glm::vec3 lo, glm::vec3 hi)
+{
+	for(int p=0;p<6;p++)
 	{
-		if(block_position.orientation==1)
-		{
-			block_position.y1-=1;
-			block_position.orientation=2;
-		}
-		else if(block_position.orientation==0)
-		{
-			block_position.y1-=1;
-		}
-		else
-		{
-			block_position.y1-=2;
-			block_position.orientation=1;
-		}
-		down_press=0;
+		const glm::vec4& plane = frustum.planes[p];
+		float x = plane.x >= 0 ? hi.x : lo.x;
+		float y = plane.y >= 0 ? hi.y : lo.y;
+		float z = plane.z >= 0 ? hi.z : lo.z;
+		if(plane.x*x + plane.y*y + plane.z*z + plane.w < 0)
+			return false;
 	}
-	if(up_press==1)
+	return true;
+}
+
+/* Draw a floor mesh unless culling is on and it can't be seen */
+void drawFloorMesh (struct VAO* mesh, glm::vec3 lo, glm::vec3 hi)
+{
+	if(frustum.enabled && !boxInFrustum(lo, hi))
 	{
-		if(block_position.orientation==1)
-		{
-			block_position.y1+=2;
-			block_position.orientation=2;
-		}
-		else if(block_position.orientation==0)
-		{
-			block_position.y1+=1;
-		}
-		else
+		frustum.culled++;
+		return;
+	}
+	frustum.drawn++;
+	draw3DObject(mesh);
+}
+
+/* Level bake - run once arena is set up, and again whenever it changes */
+void bakeFloor ()
+{
+	if(floor_mesh != NULL)
+		delete3DObject(floor_mesh);
+	floor_mesh = bakeFloorMesh(0, 0, 15, 10, &floor_mesh_min, &floor_mesh_max);
+	if(floor_mesh != NULL)
+		setObjectIndex(floor_mesh, OBJECT_FLOOR);
+	floor_mesh_dirty = false;
+}
+
+/* Copy a game state into block_position for draw_block */
+void sync_block_position(const struct sim_state& state)
+{
+	block_position.x1=state.pose.x;
+	block_position.y1=state.pose.y;
+	block_position.orientation=state.pose.orientation;
+}
+
+/* Put the block back on the start, with nothing left to interpolate or queued */
+void restart_level()
+{
+	input_queue_clear(move_queue);
+	game_state=sim_start(start_pose);
+	previous_state=game_state;
+	drawn_state=game_state;
+	sync_block_position(game_state);
+	transforms.block_dirty = true;
+}
+
+/* One simulation tick - hand the key presses to the simulation, which moves the block instantly */
+void check_key_functions()
+{
+	TRACE_ZONE("check_key_functions");
+	struct sim_input input = sim_no_input();
+	if(input_log.replaying)
+	{
+		// the log stands in for the keyboard
+		while(input_log.next < input_log.events.size() && input_log.events[input_log.next].tick == sim_tick)
+			input.press[input_log.events[input_log.next++].move] = 1;
+	}
+	else if(sim_at_rest(game_state))
+	{
+		// one queued move at a time, each starting once the last has finished, so none are lost or reordered
+		int move;
+		if(input_queue_pop(move_queue, move))
+			input.press[move] = 1;
+	}
+	if(input_log.record != NULL)
+	{
+		for(int move=0;move<NUM_MOVES;move++)
+			if(input.press[move])
+				input_log_write(input_log.record, sim_tick, frame_stats_now() - input_log.record_start, move);
+	}
+	sim_tick++;
+
+	previous_state = game_state;
+	game_state = sim_step(game_state, input, 90);
+
+	// Game over as soon as the block comes to rest with a cell off the floor
+	bool supported = world_mode ? world_supported(world_chunks, world, game_state.pose) : bitboard_supported(arena_bits, game_state.pose);
+	if(game_state.roll==MOVE_NONE && !supported)
+	{
+		printf("The block fell off - back to the start\n");
+		restart_level();
+	}
+}
+
+/* Make the chunks around the block resident, and bake the meshes of the ones new to their slot */
+/* The block's own chunk comes first and rings further out after it, so a frame never builds */
+/* more than WORLD_BAKES_PER_FRAME meshes and the far ones fill in over the next frames */
+/* Returns the number of bakes held back for a later frame */
+int stream_world_chunks (int bx, int by)
+{
+	int r, dx, dy, bakes = 0, held_back = 0;
+	for(r=0;r<=WORLD_VIEW_RADIUS;r++)
+	{
+		for(dx=-r;dx<=r;dx++)
 		{
-			block_position.y1+=1;
-			block_position.orientation=1;
+			for(dy=-r;dy<=r;dy++)
+			{
+				if(abs(dx)!=r && abs(dy)!=r)
+					continue;
+				int cx = bx+dx, cy = by+dy;
+				int slot = chunk_cache_load(world_chunks, world, cx, cy);
+				ChunkMesh& m = chunk_meshes[slot];
+				if(m.baked && m.cx==cx && m.cy==cy)
+					continue;
+				// The slot's old chunk was evicted - drop its mesh now, even if the new one has to wait,
+				// or it would still be drawn for a chunk no longer resident (and maybe resident elsewhere)
+				if(m.mesh != NULL)
+					delete3DObject(m.mesh);
+				m.mesh = NULL;
+				m.baked = false;
+				if(bakes==WORLD_BAKES_PER_FRAME) {
+					held_back++;
+					continue;
+				}
+				m.mesh = bakeFloorMesh(cx*CHUNK_SIZE, cy*CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, &m.bounds_min, &m.bounds_max);
+				if(m.mesh != NULL)
+					setObjectIndex(m.mesh, OBJECT_FLOOR);
+				m.cx = cx;
+				m.cy = cy;
+				m.baked = true;
+				bakes++;
+			}
 		}
-		up_press=0;
+	}
+	return held_back;
+}
+
+/* Draw the baked chunks within WORLD_VIEW_RADIUS of the block's chunk that are in view */
+void draw_world_chunks ()
+{
+	int bx = world_chunk_of(game_state.pose.x), by = world_chunk_of(game_state.pose.y);
+	chunk_bakes_pending = stream_world_chunks(bx, by) > 0;
+	for(size_t i=0;i<chunk_meshes.size();i++)
+	{
+		const ChunkMesh& m = chunk_meshes[i];
+		if(!m.baked || m.mesh == NULL || abs(m.cx-bx) > WORLD_VIEW_RADIUS || abs(m.cy-by) > WORLD_VIEW_RADIUS)
+			continue;
+		drawFloorMesh(m.mesh, m.bounds_min, m.bounds_max);
 	}
 }
 
 float camera_rotation_angle = 90,block_vertical_rotation=0,tile_rotation=0;
+
+/* True once every logged move has been replayed and the block has come to rest */
+bool replayFinished ()
+{
+	return input_log.next == input_log.events.size() && sim_at_rest(game_state);
+}
+
+/* Replay the whole log without a window or GL, as fast as the simulation runs */
+int runReplay ()
+{
+	double start = frame_stats_now();
+	while(!replayFinished())
+		check_key_functions();
+	double elapsed = frame_stats_now() - start;
+	printf("Replay: %u ticks in %.3f s, %.0f ticks/s, block at %d,%d\n", sim_tick, elapsed, sim_tick/elapsed, game_state.pose.x, game_state.pose.y);
+	return 0;
+}
+
+/* Draw the whole floor with a single instanced call */
+/* Tiles are static in world space, so only VP is sent */
+void draw_tiles_instanced()
+{
+	if(floor_instances.dirty)
+		updateFloorInstances();
+	if(floor_instances.NumInstances == 0)
+		return;
+
+	useProgram (floor_instances.ProgramID);
+	draw3DObjectInstanced(tile, floor_instances.NumInstances);
+	useProgram (programID);
+}
+
+/* Draw the floor - the baked mesh is already in world space, its model matrix stays identity */
 void draw_tiles()
 {
-	float x_start=-7.5,z_start=5;
-	int i,j;
-	for(i=0;i<15;i++)
+	TRACE_ZONE("draw_tiles");
+	frustum.drawn = frustum.culled = 0;
+	if(world_mode)
 	{
-		z_start=5;
-		for(j=0;j<10;j++)
-		{
-			Matrices.model = glm::mat4(1.0f);
-			glm::mat4 translateTile = glm::translate (glm::vec3(x_start,0, z_start));        
-			glm::mat4 rotateTile = glm::rotate((float)(tile_rotation*M_PI/180.0f), glm::vec3(1,1,0)); 
-			Matrices.model *= (translateTile * rotateTile);
-			MVP = VP * Matrices.model;
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-			draw3DObject(tile);
-			z_start-=1;
-		}
-		x_start+=1;
+		draw_world_chunks();
+		return;
 	}
+
+	if(floor_mode == FLOOR_INSTANCED)
+	{
+		draw_tiles_instanced();
+		return;
+	}
+
+	if(floor_mesh_dirty)
+		bakeFloor();
+	if(floor_mesh == NULL)
+		return;
+
+	drawFloorMesh(floor_mesh, floor_mesh_min, floor_mesh_max);
 }
 
-void draw_block()
+/* Rebuild the block's model matrix in transform_block if the pose changed */
+void update_block_transform()
 {
+	if(transforms.block_dirty)
+	{
+		Matrices.model = glm::mat4(1.0f);
+		glm::mat4 translateRectangle = glm::translate (glm::vec3(-7.5+block_position.x1,0.2, 5-block_position.y1));        // glTranslatef
+		glm::mat4 rotateRectangle = glm::rotate((float)(block_vertical_rotation*M_PI/180.0f), glm::vec3(0,1,0));
+		glm::mat4 translateRotate = glm::translate (glm::vec3(-1,0,0));
+		glm::mat4 translateCancel =  glm::translate (glm::vec3(1,0,0)); 
+		Matrices.model *= (translateRectangle * translateCancel* rotateRectangle * translateRotate);
+		transform_block.model[OBJECT_BLOCK] = Matrices.model;
+		transforms.block_dirty = false;
+		transforms.upload_dirty = true;
+	}
+}
 
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translateRectangle = glm::translate (glm::vec3(-7.5+block_position.x1,0.2, 5-block_position.y1));        // glTranslatef
-	glm::mat4 rotateRectangle = glm::rotate((float)(block_vertical_rotation*M_PI/180.0f), glm::vec3(0,1,0));
-	glm::mat4 translateRotate = glm::translate (glm::vec3(-1,0,0));
-	glm::mat4 translateCancel =  glm::translate (glm::vec3(1,0,0)); 
-	Matrices.model *= (translateRectangle * translateCancel* rotateRectangle * translateRotate);
-	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+/* Pose the block alpha of the way between the last two ticks */
+void interpolate_block(float alpha)
+{
+	struct sim_state state = sim_interpolate(previous_state, game_state, alpha);
+	if(state.roll!=drawn_state.roll || state.rotation!=drawn_state.rotation || !sim_same_pose(state.pose, drawn_state.pose))
+	{
+		sync_block_position(state);
+		drawn_state = state;
+		transforms.block_dirty = true;
+	}
+}
+
+void draw_block()
+{
+	TRACE_ZONE("draw_block");
 if(block_position.orientation==1)
 	draw3DObject(block_vertical);
 else if(block_position.orientation==0)
@@ -832,34 +1247,102 @@ else
 
 }
 
+void createGpuTimers ()
+{
+	for(int f=0;f<GPU_TIMER_FRAMES;f++)
+	{
+		glGenQueries(NUM_GPU_PASSES, gpu_timers.Queries[f]);
+		gpu_timers.pending[f] = false;
+	}
+	gpu_timers.frame = 0;
+}
+
+/* Move to the next ring slot, feeding the results it still holds into frame_timing */
+void collectGpuTimers ()
+{
+	static const int pass_phase[NUM_GPU_PASSES] = { PHASE_GPU_TILES, PHASE_GPU_BLOCK };
+	gpu_timers.frame = (gpu_timers.frame + 1) % GPU_TIMER_FRAMES;
+	int f = gpu_timers.frame;
+	if(!gpu_timers.pending[f])
+		return;
+	for(int pass=0;pass<NUM_GPU_PASSES;pass++)
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv(gpu_timers.Queries[f][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available)
+			continue;
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(gpu_timers.Queries[f][pass], GL_QUERY_RESULT, &ns);
+		phase_add(frame_timing, pass_phase[pass], ns/1e6);
+	}
+	gpu_timers.pending[f] = false;
+}
+
+void beginGpuTimer (int pass)
+{
+	glBeginQuery(GL_TIME_ELAPSED, gpu_timers.Queries[gpu_timers.frame][pass]);
+}
+
+void endGpuTimer ()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_timers.pending[gpu_timers.frame] = true;
+}
+
 /* Render the scene with openGL */
+/* alpha is how far the frame lies between the last simulation tick and the next one */
 /* Edit this function according to your assignment */
-void draw ()
+void draw (float alpha)
 {
+	TRACE_ZONE("draw");
+	resetRenderStateCounters();
+
 	// clear the color and depth in the frame buffer
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// use the loaded shader program
 	// Don't change unless you know what you are doing
-	glUseProgram (programID);
+	useProgram (programID);
 
-	// Eye - Location of camera. Don't change unless you are sure!!
-	glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-	// Target - Where is the camera looking at.  Don't change unless you are sure!!
-	glm::vec3 target (0, 0, 0);
-	// Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
-	glm::vec3 up (0, 1, 0);
+	interpolate_block(alpha);
 
-	// Compute Camera matrix (view)
-	// Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
-	//  Don't change unless you are sure!!
-	Matrices.view = glm::lookAt(glm::vec3(8,8,4), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	// In a streamed world the camera follows the block from tile to tile
+	if(world_mode)
+	{
+		glm::vec3 focus(-7.5+block_position.x1, 0, 5-block_position.y1);
+		if(focus != camera_focus)
+		{
+			camera_focus = focus;
+			transforms.camera_dirty = true;
+		}
+	}
 
-	// Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-	//  Don't change unless you are sure!!
-	VP = Matrices.projection * Matrices.view;
+	// Otherwise the camera is fixed, so view and VP only change when the projection does (reshapeWindow)
+	if(transforms.camera_dirty)
+	{
+		// Eye - Location of camera. Don't change unless you are sure!!
+		glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
+		// Target - Where is the camera looking at.  Don't change unless you are sure!!
+		glm::vec3 target (0, 0, 0);
+		// Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
+		glm::vec3 up (0, 1, 0);
+
+		// Compute Camera matrix (view)
+		// Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
+		//  Don't change unless you are sure!!
+		Matrices.view = glm::lookAt(glm::vec3(8,8,4), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+
+		// Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
+		//  Don't change unless you are sure!!
+		VP = Matrices.projection * Matrices.view * glm::translate(-camera_focus);
+		transform_block.VP = VP;
+		updateFrustum(VP);
+
+		transforms.camera_dirty = false;
+		transforms.upload_dirty = true;
+	}
 
-	// Send our transformation to the currently bound shader, in the "MVP" uniform
+	// Send our transformation to the shaders, in the "Transforms" uniform block
 	// For each model you render, since the MVP will be different (at least the M part)
 	//  Don't change unless you are sure!!
 	// MVP = Projection * View * Model
@@ -867,12 +1350,178 @@ void draw ()
 	// Load identity to model matrix
 	// Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
 	// glPopMatrix ();
-	check_key_functions();
+	update_block_transform();
+
+	// VP and every model matrix go to the GPU in one update, and only if one of them changed
+	if(transforms.upload_dirty)
+	{
+		uploadTransforms();
+		transforms.upload_dirty = false;
+	}
+
+	collectGpuTimers();
+	phase_begin(frame_timing, PHASE_DRAW_TILES);
+	beginGpuTimer(GPU_PASS_TILES);
 	draw_tiles();
+	endGpuTimer();
+	phase_end(frame_timing, PHASE_DRAW_TILES);
+	phase_begin(frame_timing, PHASE_DRAW_BLOCK);
+	beginGpuTimer(GPU_PASS_BLOCK);
 	draw_block();
+	endGpuTimer();
+	phase_end(frame_timing, PHASE_DRAW_BLOCK);
 
 }
 
+/* Colour and depth renderbuffers behind a framebuffer object, bound for all drawing after this */
+bool createOffscreenTarget (int width, int height)
+{
+	headless.width = width;
+	headless.height = height;
+
+	glGenRenderbuffers(1, &headless.ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless.ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &headless.DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless.DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &headless.Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, headless.Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless.DepthBuffer);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "Headless: offscreen framebuffer is incomplete" << endl;
+		return false;
+	}
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+/* Write the offscreen colour buffer as a binary PPM, top row first */
+bool writeSnapshot (const char *path)
+{
+	int w = headless.width, h = headless.height, y;
+	vector<unsigned char> pixels(w*h*3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE *out = fopen(path, "wb");
+	if(out == NULL)
+	{
+		cerr << path << ": can't write" << endl;
+		return false;
+	}
+	fprintf(out, "P6\n%d %d\n255\n", w, h);
+	for(y=h-1;y>=0;y--) // GL rows start at the bottom
+		fwrite(&pixels[y*w*3], 1, w*3, out);
+	fclose(out);
+	return true;
+}
+
+/* Draw headless.frames frames offscreen, one simulation tick each, and report the rate */
+int runHeadless (int width, int height)
+{
+	if(!createOffscreenTarget(width, height))
+		return 1;
+
+	double start = frame_stats_now(); // GLFW may not be running
+	for(int frame=0;frame<headless.frames;frame++)
+	{
+		phase_begin(frame_timing, PHASE_FRAME);
+		phase_begin(frame_timing, PHASE_TICKS);
+		check_key_functions();
+		phase_end(frame_timing, PHASE_TICKS);
+		draw(0);
+		phase_end(frame_timing, PHASE_FRAME);
+	}
+	glFinish();
+	double elapsed = frame_stats_now() - start;
+	printf("Headless: %d frames in %.3f s, %.1f frames/s\n", headless.frames, elapsed, headless.frames/elapsed);
+	if(frame_stats_file != NULL)
+		frame_stats_report(frame_timing, frame_stats_file, elapsed);
+
+	if(headless.snapshot != NULL && !writeSnapshot(headless.snapshot))
+		return 1;
+	return 0;
+}
+
+/* A GL 3.3 core context with no window, no surface and no display, from EGL on Mesa's */
+/* surfaceless platform - all drawing goes to the offscreen target, so it needs no config */
+bool initSurfaceless ()
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(client_extensions == NULL || strstr(client_extensions, "EGL_MESA_platform_surfaceless") == NULL || getPlatformDisplay == NULL)
+	{
+		cerr << "Headless: EGL has no surfaceless platform, try --context window" << endl;
+		return false;
+	}
+	EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+	{
+		cerr << "Headless: can't initialise the surfaceless EGL display" << endl;
+		return false;
+	}
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	static const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = EGL_NO_CONTEXT;
+	if(extensions != NULL && strstr(extensions, "EGL_KHR_no_config_context") != NULL
+	   && strstr(extensions, "EGL_KHR_surfaceless_context") != NULL && eglBindAPI(EGL_OPENGL_API))
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		cerr << "Headless: no surfaceless OpenGL 3.3 core context" << endl;
+		if(context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+	gladLoadGLLoader((GLADloadproc) eglGetProcAddress);
+	headless.egl_display = display;
+	headless.egl_context = context;
+	return true;
+#else
+	cerr << "Headless: built without EGL, use --context window" << endl;
+	return false;
+#endif
+}
+
+void closeSurfaceless ()
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	EGLDisplay display = headless.egl_display;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, headless.egl_context);
+	eglTerminate(display);
+#endif
+}
+
+/* The window has to be repainted (uncovered, restored), even if the scene is idle */
+void refreshWindow (GLFWwindow* window)
+{
+	redraw_requested = true;
+}
+
+/* True when the last frame drawn still shows the scene: the block is at rest and drawn at */
+/* rest, no move is queued, no chunk in view is waiting to be baked, and neither the camera */
+/* nor anything else asked for a redraw */
+bool sceneIdle ()
+{
+	return !redraw_requested && !transforms.camera_dirty && !input_log.replaying && !chunk_bakes_pending
+		&& sim_at_rest(game_state) && input_queue_empty(move_queue)
+		&& drawn_state.roll == MOVE_NONE && sim_same_pose(drawn_state.pose, game_state.pose);
+}
+
 /* Initialise glfw window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
 GLFWwindow* initGLFW (int width, int height)
@@ -888,17 +1537,28 @@ GLFWwindow* initGLFW (int width, int height)
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if(headless.frames > 0)
+	{
+		// never shown, the frames go to the offscreen framebuffer
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		if(headless.context_api != 0)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, headless.context_api);
+	}
 
 	window = glfwCreateWindow(width, height, "Sample OpenGL 3.3 Application", NULL, NULL);
 
 	if (!window) {
 		glfwTerminate();
 		//        exit(EXIT_FAILURE);
+		return NULL;
 	}
 
 	glfwMakeContextCurrent(window);
 	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-	glfwSwapInterval( 1 );
+	bool tear_control = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+	if(pacer.mode == PACING_ADAPTIVE && !tear_control)
+		cout << "Adaptive vsync isn't supported here, using vsync" << endl;
+	glfwSwapInterval( frame_pacer_swap_interval(pacer, tear_control) );
 
 	/* --- register callbacks with GLFW --- */
 
@@ -911,6 +1571,9 @@ GLFWwindow* initGLFW (int width, int height)
 	/* Register function to handle window close */
 	glfwSetWindowCloseCallback(window, quit);
 
+	/* Register function to handle window repaints, for the idle loop */
+	glfwSetWindowRefreshCallback(window, refreshWindow);
+
 	/* Register function to handle keyboard input */
 	glfwSetKeyCallback(window, keyboard);      // general keyboard input
 	glfwSetCharCallback(window, keyboardChar);  // simpler specific character handling
@@ -926,15 +1589,22 @@ GLFWwindow* initGLFW (int width, int height)
 void initGL (GLFWwindow* window, int width, int height)
 {
 	/* Objects should be created before any other gl function and shaders */
+	// Shared transform buffers first, the models refer to them
+	createTransformBuffer ();
+	createGpuTimers ();
 	// Create the models
 	createBlockVertical ();
 	createTile();
+	createFloorInstances();
 	createBlockHorizontal1();
 	createBlockHorizontal2();
 	// Create and compile our GLSL program from the shaders
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	// Both programs read their transforms from the shared "Transforms" block
+	bindTransformBlock(programID);
+	// Instanced floor program, shares the fragment shader
+	floor_instances.ProgramID = LoadShaders( "Floor_GL.vert", "Sample_GL.frag" );
+	bindTransformBlock(floor_instances.ProgramID);
 
 
 	reshapeWindow (window, width, height);
@@ -955,50 +1625,339 @@ void initGL (GLFWwindow* window, int width, int height)
 void initialiseArena()
 {
 	int i,j;
-	for(i=0;i<15;i++)
+	if(world_mode)
 	{
-		for(j=0;j<10;j++)
+		// the world has no arena, only its start and goal are needed
+		goal_x=world.goal_x;
+		goal_y=world.goal_y;
+		start_pose=world.start;
+		restart_level();
+		return;
+	}
+	if(current_level.width > 0)
+	{
+		// the loaded level sits in the corner of the arena, the rest is empty
+		for(i=0;i<15;i++)
+		{
+			for(j=0;j<10;j++)
+			{
+				if(i<current_level.width && j<current_level.height)
+					arena[i][j]=current_level.cells[i*current_level.height + j];
+				else
+					arena[i][j]=0;
+			}
+		}
+		goal_x=current_level.goal_x;
+		goal_y=current_level.goal_y;
+	}
+	else
+	{
+		for(i=0;i<15;i++)
 		{
-			arena[i][j]=1;
+			for(j=0;j<10;j++)
+			{
+				arena[i][j]=1;
+			}
 		}
+		goal_x=12;
+		goal_y=5;
+		arena[goal_x][goal_y]=2;
 	}
-	block_position.x1=5;
-	block_position.y1=5;
-	block_position.orientation=1;
+	floor_instances.dirty = true;
+	floor_mesh_dirty = true;
+	struct sim_board board = { 15, 10, &arena[0][0] };
+	bitboard_build(arena_bits, board);
+
+	if(current_level.width > 0)
+		start_pose=current_level.start;
+	else
+	{
+		start_pose.x=5;
+		start_pose.y=5;
+		start_pose.orientation=ORIENT_UP;
+	}
+	restart_level();
+}
+
+/* Control based on time (Time based transformation like 5 degrees rotation every 0.5s) */
+/* Run after every frame, and after every idle wait so the reports keep coming while nothing is drawn */
+void timedUpdate (GLFWwindow* window, double& last_update_time)
+{
+	double current_time = glfwGetTime(); // Time in seconds
+	if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
+		// do something every 0.5 seconds ..
+		if(show_render_stats)
+		{
+			printf("GL state calls per frame: %d issued, %d skipped\n", render_state.frame_calls_issued, render_state.frame_calls_skipped);
+			printf("Floor meshes: %d drawn, %d culled%s\n", frustum.drawn, frustum.culled, frustum.enabled ? "" : " (culling off)");
+			printf("Moves dropped beyond the look-ahead of %d: %u\n", move_queue.lookahead, move_queue.dropped);
+		}
+		if(frame_stats_file != NULL)
+		{
+			frame_stats_report(frame_timing, frame_stats_file, current_time);
+			fprintf(frame_stats_file, "pacing %s, jitter %.3f ms (interval p99 - p50)\n", frame_pacer_name(pacer), frame_pacer_jitter(frame_timing));
+			fprintf(frame_stats_file, "moves dropped beyond the look-ahead of %d: %u\n\n", move_queue.lookahead, move_queue.dropped);
+		}
+		if(show_frame_stats)
+		{
+			struct phase_summary frame = phase_summarize(frame_timing.phases[PHASE_FRAME]);
+			char title[128];
+			snprintf(title, sizeof(title), "Frame %.2f ms p50, %.2f ms p99, %.2f ms max, jitter %.2f ms (%s)", frame.p50, frame.p99, frame.max, frame_pacer_jitter(frame_timing), frame_pacer_name(pacer));
+			glfwSetWindowTitle(window, title);
+		}
+		last_update_time = current_time;
+	}
+}
+
+/* Write the trace and close the session files - on every way out, while GL is still up */
+void finishSession ()
+{
+	if(trace_on_exit && !trace_write(trace_path))
+		cerr << trace_path << ": can't write the trace" << endl;
+	if(frame_stats_file != NULL)
+		fclose(frame_stats_file);
+	if(input_log.record != NULL)
+		fclose(input_log.record);
+	frame_stats_file = NULL;
+	input_log.record = NULL;
 }
 
 int main (int argc, char** argv)
 {
 	int width = 900;
 	int height = 600;
+	int i;
+	const char *record_path = NULL;
+	int lookahead = DEFAULT_LOOKAHEAD;
+	double replay_tick_rate = 0;
+
+	for(i=1;i<argc;i++)
+	{
+		if(string(argv[i])=="--tick-rate" && i+1<argc)
+			sim_tick_rate = atof(argv[++i]);
+		else if(string(argv[i])=="--level" && i+1<argc)
+		{
+			string error;
+			if(!load_level(argv[++i], current_level, error)) {
+				cerr << error << endl;
+				return 1;
+			}
+			if(current_level.width > 15 || current_level.height > 10) {
+				cerr << current_level.name << ": bigger than the 15x10 arena" << endl;
+				return 1;
+			}
+		}
+		else if(string(argv[i])=="--frame-stats" && i+1<argc)
+		{
+			frame_stats_file = fopen(argv[++i], "w");
+			if(frame_stats_file == NULL) {
+				cerr << argv[i] << ": can't write" << endl;
+				return 1;
+			}
+		}
+		else if(string(argv[i])=="--trace" && i+1<argc)
+		{
+			trace_path = argv[++i];
+			trace_on_exit = true;
+		}
+		else if(string(argv[i])=="--lookahead" && i+1<argc)
+			lookahead = atoi(argv[++i]);
+		else if(string(argv[i])=="--record" && i+1<argc)
+			record_path = argv[++i];
+		else if(string(argv[i])=="--replay" && i+1<argc)
+		{
+			struct input_log_header header;
+			string error;
+			if(!input_log_read(argv[++i], header, input_log.events, error)) {
+				cerr << error << endl;
+				return 1;
+			}
+			input_log.replaying = true;
+			replay_tick_rate = header.tick_rate;
+		}
+		else if(string(argv[i])=="--replay-speed" && i+1<argc)
+			input_log.speed = atof(argv[++i]);
+		else if(string(argv[i])=="--pacing" && i+1<argc)
+		{
+			if(!frame_pacer_parse(pacer, argv[++i])) {
+				cerr << "--pacing takes vsync, uncapped, adaptive or a frame rate" << endl;
+				return 1;
+			}
+		}
+		else if(string(argv[i])=="--shader-dir" && i+1<argc)
+			shader_dir = argv[++i];
+		else if(string(argv[i])=="--no-idle")
+			idle_rendering = false;
+		else if(string(argv[i])=="--no-render")
+			input_log.render = false;
+		else if(string(argv[i])=="--headless" && i+1<argc)
+			headless.frames = atoi(argv[++i]);
+		else if(string(argv[i])=="--snapshot" && i+1<argc)
+			headless.snapshot = argv[++i];
+		else if(string(argv[i])=="--context" && i+1<argc)
+		{
+			string api = argv[++i];
+			headless.surfaceless = api=="surfaceless";
+			if(api=="egl")
+				headless.context_api = GLFW_EGL_CONTEXT_API;
+			else if(api=="osmesa")
+				headless.context_api = GLFW_OSMESA_CONTEXT_API;
+			else if(api!="window" && api!="surfaceless") {
+				cerr << "--context takes surfaceless, window, egl or osmesa" << endl;
+				return 1;
+			}
+		}
+		else if(string(argv[i])=="--world" && i+1<argc)
+		{
+			string name = argv[++i], error;
+			if(name.find_first_not_of("0123456789") == string::npos)
+				world_generate(world, strtoul(name.c_str(), NULL, 10));
+			else if(!world_open(world, name, error)) {
+				cerr << error << endl;
+				return 1;
+			}
+			world_mode = true;
+			chunk_cache_init(world_chunks, WORLD_CHUNK_SLOTS);
+			ChunkMesh empty = {}; // no mesh, not baked
+			chunk_meshes.assign(WORLD_CHUNK_SLOTS, empty);
+		}
+	}
+	if(sim_tick_rate <= 0)
+		sim_tick_rate = 60;
+	if(input_log.replaying)
+		sim_tick_rate = replay_tick_rate; // the log only replays at the rate it was made at
+	if(input_log.speed <= 0)
+		input_log.speed = 1;
+	input_queue_init(move_queue, lookahead);
+	if(record_path != NULL)
+	{
+		input_log.record = input_log_create(record_path, sim_tick_rate);
+		if(input_log.record == NULL) {
+			cerr << record_path << ": can't write" << endl;
+			return 1;
+		}
+		input_log.record_start = frame_stats_now();
+	}
 
 	initialiseArena();
-	GLFWwindow* window = initGLFW(width, height);
+	if(input_log.replaying && !input_log.render)
+	{
+		int status = runReplay();
+		finishSession();
+		return status;
+	}
+
+	GLFWwindow* window = NULL;
+	if(headless.frames > 0 && headless.surfaceless)
+	{
+		if(!initSurfaceless())
+			return 1;
+	}
+	else
+	{
+		window = initGLFW(width, height);
+		if(window == NULL) // no display or no GL 3.3 context
+			return 1;
+	}
 
 	initGL (window, width, height);
 
+	// Bake the static floor for the level set up by initialiseArena - worlds bake chunks as they stream in
+	if(!world_mode)
+		bakeFloor();
+
+	if(headless.frames > 0)
+	{
+		int status = runHeadless(width, height);
+		finishSession();
+		if(window == NULL)
+			closeSurfaceless();
+		else
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
+		return status;
+	}
+
 	double last_update_time = glfwGetTime(), current_time;
+	double last_frame_time = last_update_time, accumulator = 0;
+	double tick = 1.0/sim_tick_rate;
+	double time_scale = input_log.replaying ? input_log.speed : 1;
 
 	/* Draw in loop */
 	while (!glfwWindowShouldClose(window)) {
 
+		// Nothing to animate: sleep until an event arrives rather than redraw an unchanged frame
+		if(idle_rendering && sceneIdle())
+		{
+			{
+				TRACE_ZONE("idle");
+				glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			}
+			last_frame_time = glfwGetTime(); // the block was at rest, there is no time to catch up
+			frame_pacer_reset(pacer);
+			if(sceneIdle()) {
+				timedUpdate(window, last_update_time);
+				continue;
+			}
+		}
+
+		phase_begin(frame_timing, PHASE_FRAME);
+
+		// Run as many fixed simulation ticks as the elapsed time covers
+		current_time = glfwGetTime();
+		accumulator += (current_time - last_frame_time) * time_scale;
+		last_frame_time = current_time;
+		if(accumulator > 0.25*time_scale) // don't try to catch up after a long stall
+			accumulator = 0.25*time_scale;
+		phase_begin(frame_timing, PHASE_TICKS);
+		while(accumulator >= tick)
+		{
+			check_key_functions();
+			accumulator -= tick;
+		}
+		phase_end(frame_timing, PHASE_TICKS);
+		if(input_log.replaying && replayFinished())
+		{
+			printf("Replay finished after %u ticks\n", sim_tick);
+			glfwSetWindowShouldClose(window, 1);
+		}
+
 		// OpenGL Draw commands
-		draw();
+		draw(accumulator/tick);
+		redraw_requested = false;
 
 		// Swap Frame Buffer in double buffering
-		glfwSwapBuffers(window);
+		phase_begin(frame_timing, PHASE_SWAP);
+		{
+			TRACE_ZONE("swap");
+			glfwSwapBuffers(window);
+		}
+		phase_end(frame_timing, PHASE_SWAP);
+		frame_pacer_presented(pacer, frame_timing);
 
-		// Poll for Keyboard and mouse events
-		glfwPollEvents();
+		// A fixed frame rate waits here, so that the events polled next are as fresh as they can be
+		{
+			TRACE_ZONE("pace");
+			frame_pacer_wait(pacer);
+		}
 
-		// Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-		current_time = glfwGetTime(); // Time in seconds
-		if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
-			// do something every 0.5 seconds ..
-			last_update_time = current_time;
+		// Poll for Keyboard and mouse events
+		phase_begin(frame_timing, PHASE_POLL);
+		{
+			TRACE_ZONE("poll");
+			glfwPollEvents();
 		}
+		phase_end(frame_timing, PHASE_POLL);
+
+		phase_end(frame_timing, PHASE_FRAME);
+
+		timedUpdate(window, last_update_time);
 	}
 
+	finishSession();
+	glfwDestroyWindow(window);
 	glfwTerminate();
 	//    exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,118 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Scoped zone tracer, written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) */
+/* TRACE_ZONE("name") records one complete event for the rest of the enclosing scope. Every */
+/* thread appends to its own ring of the last TRACE_RING_EVENTS events, so recording takes no */
+/* lock - only a thread's first event registers its ring. trace_write can run at any time; */
+/* a ring is read up to the position its thread had published, oldest event first. */
+
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#define TRACE_RING_EVENTS 65536 // per thread, a power of two
+
+struct trace_event {
+	const char *name; // must outlive the trace - string literals
+	double start_us;
+	double duration_us;
+};
+
+struct trace_ring {
+	int tid;
+	std::atomic<uint32_t> head; // events ever written; only the owning thread stores to it
+	struct trace_event events[TRACE_RING_EVENTS];
+};
+
+struct trace_registry {
+	std::mutex lock; // only taken to add a ring and to write the trace
+	std::vector<struct trace_ring*> rings;
+	std::chrono::steady_clock::time_point origin;
+	trace_registry () : origin(std::chrono::steady_clock::now()) {}
+};
+
+inline struct trace_registry& trace_rings ()
+{
+	static struct trace_registry registry; // set up by whichever thread gets here first
+	return registry;
+}
+
+/* Microseconds since the tracer started */
+inline double trace_now ()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - trace_rings().origin).count();
+}
+
+inline struct trace_ring* trace_thread_ring ()
+{
+	static thread_local struct trace_ring *ring = NULL;
+	if(ring == NULL)
+	{
+		struct trace_registry& registry = trace_rings();
+		ring = new trace_ring; // kept for the trace written at exit, even after the thread ends
+		ring->head.store(0, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> guard(registry.lock);
+		ring->tid = registry.rings.size() + 1;
+		registry.rings.push_back(ring);
+	}
+	return ring;
+}
+
+inline void trace_record (const char *name, double start_us, double end_us)
+{
+	struct trace_ring *ring = trace_thread_ring();
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	struct trace_event& e = ring->events[head & (TRACE_RING_EVENTS-1)];
+	e.name = name;
+	e.start_us = start_us;
+	e.duration_us = end_us - start_us;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+struct trace_zone {
+	const char *name;
+	double start_us;
+	explicit trace_zone (const char *zone_name) : name(zone_name), start_us(trace_now()) {}
+	~trace_zone () { trace_record(name, start_us, trace_now()); }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) struct trace_zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+/* Write every ring as Chrome trace JSON - returns false if the file can't be written */
+inline bool trace_write (const char *path)
+{
+	FILE *out = fopen(path, "w");
+	if(out == NULL)
+		return false;
+
+	struct trace_registry& registry = trace_rings();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for(size_t r=0;r<registry.rings.size();r++)
+	{
+		const struct trace_ring *ring = registry.rings[r];
+		uint32_t head = ring->head.load(std::memory_order_acquire);
+		uint32_t count = head < TRACE_RING_EVENTS ? head : TRACE_RING_EVENTS;
+		for(uint32_t i=head-count;i!=head;i++)
+		{
+			const struct trace_event& e = ring->events[i & (TRACE_RING_EVENTS-1)];
+			fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			        first ? "" : ",\n", e.name, ring->tid, e.start_us, e.duration_us);
+			first = false;
+		}
+	}
+	fprintf(out, "\n]}\n");
+	bool ok = !ferror(out);
+	if(fclose(out) != 0)
+		ok = false;
+	return ok;
+}
+
+#endif
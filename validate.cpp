@@ -0,0 +1,142 @@
+/* Batch level validator - checks every level for solvability and its optimal move count */
+/* usage: validate [-j threads] [-o results] <level file, pack or directory>... */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+#include "simulation.h"
+#include "bitboard.h"
+#include "solver.h"
+#include "level.h"
+#include "levelpack.h"
+
+using namespace std;
+
+/* Work stealing pool - every worker pops from the back of its own queue and, */
+/* once that is empty, steals from the front of the others' */
+struct work_queue {
+	mutex lock;
+	deque<int> tasks;
+};
+
+struct work_pool {
+	vector<work_queue*> queues;
+};
+
+bool take_task (work_pool& pool, int self, int& task)
+{
+	work_queue *own = pool.queues[self];
+	{
+		lock_guard<mutex> guard(own->lock);
+		if(!own->tasks.empty()) {
+			task = own->tasks.back();
+			own->tasks.pop_back();
+			return true;
+		}
+	}
+	int n = pool.queues.size();
+	for(int i=1;i<n;i++)
+	{
+		work_queue *victim = pool.queues[(self+i)%n];
+		lock_guard<mutex> guard(victim->lock);
+		if(!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Solve every level a worker can get hold of, with one solver reused for all of them */
+void worker (work_pool& pool, int self, const vector<level>& levels, vector<int>& results)
+{
+	struct solver s;
+	struct bitboard board;
+	int task;
+	while(take_task(pool, self, task))
+	{
+		const level& l = levels[task];
+		bitboard_build(board, level_board(l));
+		results[task] = solve(s, board, l.start, l.goal_x, l.goal_y);
+	}
+}
+
+int main (int argc, char** argv)
+{
+	int threads = thread::hardware_concurrency();
+	const char *output = NULL;
+	vector<string> inputs;
+	int i;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i], "-j")==0 && i+1<argc)
+			threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-o")==0 && i+1<argc)
+			output = argv[++i];
+		else
+			inputs.push_back(argv[i]);
+	}
+	if(inputs.empty()) {
+		fprintf(stderr, "usage: %s [-j threads] [-o results] <level file, pack or directory>...\n", argv[0]);
+		return 2;
+	}
+	if(threads < 1)
+		threads = 1;
+
+	vector<level> levels;
+	string error;
+	for(i=0;i<(int)inputs.size();i++)
+	{
+		if(!load_levels(inputs[i], levels, error)) {
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+
+	// Deal the levels out round robin, stealing evens out whatever is left
+	work_pool pool;
+	for(i=0;i<threads;i++)
+		pool.queues.push_back(new work_queue);
+	for(i=0;i<(int)levels.size();i++)
+		pool.queues[i%threads]->tasks.push_back(i);
+
+	vector<int> results(levels.size(), -1);
+	vector<thread> workers;
+	for(i=0;i<threads;i++)
+		workers.push_back(thread(worker, ref(pool), i, cref(levels), ref(results)));
+	for(i=0;i<threads;i++)
+		workers[i].join();
+	for(i=0;i<threads;i++)
+		delete pool.queues[i];
+
+	FILE *out = stdout;
+	if(output != NULL && (out = fopen(output, "w")) == NULL) {
+		fprintf(stderr, "%s: can't write\n", output);
+		return 1;
+	}
+	int unsolvable = 0;
+	for(i=0;i<(int)levels.size();i++)
+	{
+		if(results[i] < 0) {
+			fprintf(out, "%s\tunsolvable\n", levels[i].name.c_str());
+			unsolvable++;
+		}
+		else
+			fprintf(out, "%s\t%d\n", levels[i].name.c_str(), results[i]);
+	}
+	if(out != stdout)
+		fclose(out);
+
+	fprintf(stderr, "%d levels, %d unsolvable\n", (int)levels.size(), unsolvable);
+	return unsolvable == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+/* Unbounded worlds, streamed in CHUNK_SIZE x CHUNK_SIZE chunks */
+/* A world_source gives the cell at any x, y - either generated from a seed or read from the */
+/* bits of a level, which stay in the mapped pack file. A chunk_cache keeps a fixed number of */
+/* chunks resident and hands the least recently used slot to the next chunk loaded, so memory */
+/* stays the same however far the block travels. */
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "simulation.h"
+#include "level.h"
+#include "levelpack.h"
+
+#define CHUNK_SIZE 32
+
+struct world_source {
+	uint32_t seed;              // generated world when bits is NULL
+	const unsigned char *bits;  // else one bit per cell, x*height + y as in level packs
+	int width, height;
+	int goal_x, goal_y;
+	struct sim_pose start;
+	struct level_pack pack;                  // keeps bits mapped for levels read from a pack
+	std::vector<unsigned char> loaded_bits;  // holds bits for levels read from text
+};
+
+inline uint32_t world_hash (uint32_t seed, int x, int y)
+{
+	uint32_t h = seed ^ ((uint32_t)x * 0x9e3779b1u) ^ ((uint32_t)y * 0x85ebca77u);
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return h;
+}
+
+/* Cell value as in arena: 0 no floor, 1 floor, 2 goal */
+inline int world_cell (const struct world_source& w, int x, int y)
+{
+	if(w.bits != NULL)
+	{
+		if(x<0 || x>=w.width || y<0 || y>=w.height)
+			return 0;
+		if(x == w.goal_x && y == w.goal_y)
+			return 2;
+		size_t bit = (size_t)x*w.height + y;
+		return (w.bits[bit>>3] >> (bit&7)) & 1;
+	}
+
+	// Generated: a grid of roads every 8 cells, islands between them that are mostly floor
+	// with a few holes, the odd goal tile, and solid ground around the start
+	if(x>=-2 && x<=2 && y>=-2 && y<=2)
+		return 1;
+	if((x&7) == 3 || (y&7) == 3)
+		return 1;
+	if(world_hash(w.seed, x>>3, y>>3) % 10 >= 7)
+		return 0;
+	uint32_t h = world_hash(w.seed + 1, x, y);
+	if(h % 100 < 8)
+		return 0;
+	return (h >> 16) % 256 == 0 ? 2 : 1;
+}
+
+/* Generated world of the given seed, starting at the origin */
+inline void world_generate (struct world_source& w, uint32_t seed)
+{
+	w.seed = seed;
+	w.bits = NULL;
+	w.width = w.height = 0;
+	w.goal_x = w.goal_y = 0;
+	w.start.x = w.start.y = 0;
+	w.start.orientation = ORIENT_UP;
+}
+
+/* World made of one level, <file>[:<index>] as load_level takes - a pack level is used in place */
+inline bool world_open (struct world_source& w, const std::string& name, std::string& error)
+{
+	world_generate(w, 0);
+
+	std::string path = name;
+	int index = 0;
+	size_t colon = name.rfind(':');
+	if(colon != std::string::npos && colon+1 < name.size() && name.find_first_not_of("0123456789", colon+1) == std::string::npos)
+	{
+		path = name.substr(0, colon);
+		index = atoi(name.c_str() + colon+1);
+	}
+
+	if(is_level_pack(path))
+	{
+		struct levelpack_record record;
+		if(!level_pack_open(w.pack, path, error))
+			return false;
+		if(!level_pack_find(w.pack, index, record, w.bits, error)) {
+			level_pack_close(w.pack);
+			w.bits = NULL;
+			return false;
+		}
+		w.width = record.width;
+		w.height = record.height;
+		w.start.x = record.start_x;
+		w.start.y = record.start_y;
+		w.start.orientation = record.start_orientation;
+		w.goal_x = record.goal_x;
+		w.goal_y = record.goal_y;
+		if(w.start.orientation > ORIENT_Y) {
+			error = name + ": bad start pose";
+			return false;
+		}
+		return true;
+	}
+
+	struct level l;
+	if(!load_level(name, l, error))
+		return false;
+	w.width = l.width;
+	w.height = l.height;
+	w.start = l.start;
+	w.goal_x = l.goal_x;
+	w.goal_y = l.goal_y;
+	w.loaded_bits.assign(levelpack_cell_bytes(l.width, l.height), 0);
+	for(size_t i=0;i<l.cells.size();i++)
+		if(l.cells[i] != 0)
+			w.loaded_bits[i>>3] |= 1 << (i&7);
+	w.bits = w.loaded_bits.empty() ? NULL : &w.loaded_bits[0];
+	return w.bits != NULL;
+}
+
+/* Chunk holding cell coordinate v, rounding down for negative v */
+inline int world_chunk_of (int v)
+{
+	return v >= 0 ? v / CHUNK_SIZE : -((-v-1) / CHUNK_SIZE) - 1;
+}
+
+struct world_chunk {
+	int cx, cy;       // chunk coordinates, cells cx*CHUNK_SIZE .. +CHUNK_SIZE-1
+	bool loaded;
+	uint64_t last_used;
+	int cells[CHUNK_SIZE*CHUNK_SIZE]; // x*CHUNK_SIZE + y, local coordinates
+};
+
+struct chunk_cache {
+	std::vector<struct world_chunk> slots;
+	uint64_t clock;
+	int loads;        // chunks filled since the cache was set up
+	int last_slot;    // slot of the last lookup, tried first
+};
+
+inline void chunk_cache_init (struct chunk_cache& cache, int capacity)
+{
+	cache.slots.resize(capacity);
+	for(int i=0;i<capacity;i++)
+		cache.slots[i].loaded = false;
+	cache.clock = 0;
+	cache.loads = 0;
+	cache.last_slot = 0;
+}
+
+/* Slot holding chunk cx, cy, or -1 if it isn't resident */
+inline int chunk_cache_find (struct chunk_cache& cache, int cx, int cy)
+{
+	const struct world_chunk& last = cache.slots[cache.last_slot];
+	if(last.loaded && last.cx == cx && last.cy == cy)
+		return cache.last_slot;
+	for(size_t i=0;i<cache.slots.size();i++)
+	{
+		const struct world_chunk& c = cache.slots[i];
+		if(c.loaded && c.cx == cx && c.cy == cy)
+			return cache.last_slot = i;
+	}
+	return -1;
+}
+
+/* Slot holding chunk cx, cy, filling the least recently used slot if it isn't resident */
+/* The chunk that was in that slot is dropped - callers keeping data per slot must check cx, cy */
+inline int chunk_cache_load (struct chunk_cache& cache, const struct world_source& w, int cx, int cy)
+{
+	int slot = chunk_cache_find(cache, cx, cy);
+	if(slot < 0)
+	{
+		slot = 0;
+		for(size_t i=0;i<cache.slots.size();i++)
+		{
+			if(!cache.slots[i].loaded) {
+				slot = i;
+				break;
+			}
+			if(cache.slots[i].last_used < cache.slots[slot].last_used)
+				slot = i;
+		}
+		struct world_chunk& c = cache.slots[slot];
+		int x, y;
+		c.cx = cx;
+		c.cy = cy;
+		for(x=0;x<CHUNK_SIZE;x++)
+			for(y=0;y<CHUNK_SIZE;y++)
+				c.cells[x*CHUNK_SIZE + y] = world_cell(w, cx*CHUNK_SIZE + x, cy*CHUNK_SIZE + y);
+		c.loaded = true;
+		cache.loads++;
+		cache.last_slot = slot;
+	}
+	cache.slots[slot].last_used = ++cache.clock;
+	return slot;
+}
+
+/* Cell x, y from its chunk if resident, otherwise straight from the source - never evicts */
+inline int chunk_cache_cell (struct chunk_cache& cache, const struct world_source& w, int x, int y)
+{
+	int cx = world_chunk_of(x), cy = world_chunk_of(y);
+	int slot = chunk_cache_find(cache, cx, cy);
+	if(slot < 0)
+		return world_cell(w, x, y);
+	return cache.slots[slot].cells[(x - cx*CHUNK_SIZE)*CHUNK_SIZE + (y - cy*CHUNK_SIZE)];
+}
+
+/* sim_supported for a world */
+inline bool world_supported (struct chunk_cache& cache, const struct world_source& w, struct sim_pose pose)
+{
+	if(chunk_cache_cell(cache, w, pose.x, pose.y) == 0)
+		return false;
+	if(pose.orientation == ORIENT_X)
+		return chunk_cache_cell(cache, w, pose.x+1, pose.y) != 0;
+	if(pose.orientation == ORIENT_Y)
+		return chunk_cache_cell(cache, w, pose.x, pose.y-1) != 0;
+	return true;
+}
+
+#endif